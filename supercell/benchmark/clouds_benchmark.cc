@@ -0,0 +1,985 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Microbenchmarks for the DSP kernels.
+//
+// Each kernel is run kNumRuns times on the same data, and the fastest run is
+// reported, in CPU cycles (as counted by the TSC) per sample. The results are
+// written as CSV to the standard output, or to the file given as argument.
+// The round-trip latency of the processor is reported in the same file, in
+// samples, for each codec block size. When built with GRAIN_THREADS=1, the
+// granular processor is also measured with its grains rendered on 2 and 4
+// threads.
+
+#include <x86intrin.h>
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "stmlib/dsp/filter.h"
+#include "stmlib/utils/random.h"
+
+#include "supercell/dsp/audio_buffer.h"
+#include "supercell/dsp/correlator.h"
+#include "supercell/dsp/frame.h"
+#include "supercell/dsp/fx/diffuser.h"
+#include "supercell/dsp/fx/oliverb.h"
+#include "supercell/dsp/fx/pitch_shifter.h"
+#include "supercell/dsp/fx/reverb.h"
+#include "supercell/dsp/fx/reverb_bank.h"
+#include "supercell/dsp/grain.h"
+#include "supercell/dsp/granular_processor.h"
+#include "supercell/dsp/kernels.h"
+#include "supercell/dsp/mu_law.h"
+#include "supercell/dsp/parameters.h"
+#include "supercell/dsp/pvoc/frame_transformation.h"
+#include "supercell/dsp/pvoc/spectral_clouds_transformation.h"
+#include "supercell/dsp/pvoc/stft.h"
+#include "supercell/dsp/resonestor.h"
+#include "supercell/dsp/sample_rate_converter.h"
+#include "supercell/resources.h"
+
+using namespace clouds;
+using namespace std;
+using namespace stmlib;
+
+const size_t kNumRuns = 32;
+const size_t kBlockSize = 32;
+const size_t kNumBlocks = 128;
+
+// Results are accumulated here so that the compiler can't optimize the
+// kernels away.
+volatile float sink;
+
+FILE* output;
+
+float Noise() {
+  return Random::GetFloat() * 2.0f - 1.0f;
+}
+
+// Kernel must provide:
+// - Prepare(), which is not timed, to bring the kernel to the same state
+//   before each run.
+// - Run(), which processes num_samples() samples.
+template<typename Kernel>
+void Measure(const char* kernel_name, const char* variant, Kernel* kernel) {
+  uint64_t best = ~0ULL;
+  for (size_t run = 0; run < kNumRuns + 1; ++run) {
+    kernel->Prepare();
+    uint64_t start = __rdtsc();
+    kernel->Run();
+    uint64_t elapsed = __rdtsc() - start;
+    // The first run only warms up the caches.
+    if (run) {
+      best = min(best, elapsed);
+    }
+  }
+  size_t num_samples = kernel->num_samples();
+  fprintf(
+      output,
+      "%s,%s,%lu,%llu,%.2f\n",
+      kernel_name,
+      variant,
+      static_cast<unsigned long>(num_samples),
+      static_cast<unsigned long long>(best),
+      static_cast<double>(best) / num_samples);
+  fflush(output);
+}
+
+// -----------------------------------------------------------------------------
+//
+// Recording buffer.
+
+template<Resolution resolution>
+void FillBuffer(AudioBuffer<resolution>* buffer, size_t size) {
+  vector<float> noise(size);
+  for (size_t i = 0; i < size; ++i) {
+    noise[i] = Noise() * 0.5f;
+  }
+  for (size_t i = 0; i < size; i += kBlockSize) {
+    buffer->Write(&noise[i], kBlockSize, 1);
+  }
+}
+
+template<Resolution resolution, InterpolationMethod method>
+class AudioBufferRead {
+ public:
+  AudioBufferRead() : memory_(kBufferSize + kInterpolationTail) { }
+
+  void Init() {
+    buffer_.Init(&memory_[0], memory_.size(), tail_);
+    FillBuffer(&buffer_, kBufferSize);
+  }
+
+  void Prepare() { }
+
+  void Run() {
+    // Reads at a pitch of +5 semitones.
+    uint32_t phase = 0;
+    float sum = 0.0f;
+    for (size_t i = 0; i < num_samples(); ++i) {
+      sum += buffer_.template Read<method>(phase >> 16, phase & 0xffff);
+      phase += 87500;
+    }
+    sink = sum;
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks; }
+
+ private:
+  static const int32_t kBufferSize = 16384;
+
+  // Large enough for any resolution.
+  vector<float> memory_;
+  int16_t tail_[kCrossFadeSize];
+  AudioBuffer<resolution> buffer_;
+};
+
+// Records blocks of interleaved stereo frames, as the processor does. With
+// fade, only the crossfade made when recording resumes is timed: the signal
+// received while the buffer was frozen is recorded by Prepare().
+template<Resolution resolution, bool fade>
+class AudioBufferWrite {
+ public:
+  AudioBufferWrite() : memory_(kBufferSize + kInterpolationTail) { }
+
+  void Init() {
+    buffer_.Init(&memory_[0], memory_.size(), tail_);
+    for (size_t i = 0; i < kBlockSize * kNumBlocks * 2; ++i) {
+      in_[i] = Noise() * 0.5f;
+    }
+  }
+
+  void Prepare() {
+    if (fade) {
+      for (int32_t i = 0; i < kCrossFadeSize; i += kBlockSize) {
+        buffer_.WriteFade(&in_[i * 2], kBlockSize, 2, false);
+      }
+    }
+  }
+
+  void Run() {
+    for (size_t i = 0; i < num_samples(); i += kBlockSize) {
+      if (fade) {
+        buffer_.WriteFade(&in_[i * 2], kBlockSize, 2, true);
+      } else {
+        buffer_.Write(&in_[i * 2], kBlockSize, 2);
+      }
+    }
+    sink = buffer_.ReadZOH(buffer_.head(), 0);
+  }
+
+  size_t num_samples() const {
+    return fade ? kCrossFadeSize : kBlockSize * kNumBlocks;
+  }
+
+ private:
+  static const int32_t kBufferSize = 16384;
+
+  // Large enough for any resolution.
+  vector<float> memory_;
+  int16_t tail_[kCrossFadeSize];
+  float in_[kBlockSize * kNumBlocks * 2];
+  AudioBuffer<resolution> buffer_;
+};
+
+template<Resolution resolution>
+void MeasureAudioBufferRead(const char* name) {
+  AudioBufferRead<resolution, INTERPOLATION_ZOH> zoh;
+  AudioBufferRead<resolution, INTERPOLATION_LINEAR> linear;
+  AudioBufferRead<resolution, INTERPOLATION_HERMITE> hermite;
+  zoh.Init();
+  linear.Init();
+  hermite.Init();
+  char variant[64];
+  sprintf(variant, "%s/zoh", name);
+  Measure("AudioBuffer::Read", variant, &zoh);
+  sprintf(variant, "%s/linear", name);
+  Measure("AudioBuffer::Read", variant, &linear);
+  sprintf(variant, "%s/hermite", name);
+  Measure("AudioBuffer::Read", variant, &hermite);
+}
+
+template<Resolution resolution>
+void MeasureAudioBufferWrite(const char* name) {
+  AudioBufferWrite<resolution, false> write;
+  AudioBufferWrite<resolution, true> write_fade;
+  write.Init();
+  write_fade.Init();
+  Measure("AudioBuffer::Write", name, &write);
+  Measure("AudioBuffer::WriteFade", name, &write_fade);
+}
+
+// -----------------------------------------------------------------------------
+//
+// Grains.
+
+template<int32_t num_channels, GrainQuality quality>
+class GrainOverlapAdd {
+ public:
+  GrainOverlapAdd() {
+    memory_[0].resize(kBufferSize + kInterpolationTail);
+    memory_[1].resize(kBufferSize + kInterpolationTail);
+  }
+
+  void Init() {
+    for (int32_t i = 0; i < 2; ++i) {
+      buffer_[i].Init(&memory_[i][0], memory_[i].size(), tail_[i]);
+      FillBuffer(&buffer_[i], kBufferSize);
+    }
+    grain_.Init();
+  }
+
+  void Prepare() {
+    grain_.Start(
+        0, kBufferSize, 0, num_samples() + kBlockSize, false,
+        87500, 0.5f, 0.7f, 0.3f, quality);
+    fill(&out_[0], &out_[kBlockSize * 2], 0.0f);
+  }
+
+  void Run() {
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+      grain_.template OverlapAdd<num_channels, quality>(
+          buffer_, out_, envelope_, kBlockSize);
+    }
+    sink = out_[0];
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks; }
+
+ private:
+  static const int32_t kBufferSize = 16384;
+
+  vector<int16_t> memory_[2];
+  int16_t tail_[2][kCrossFadeSize];
+  AudioBuffer<RESOLUTION_16_BIT> buffer_[2];
+  Grain grain_;
+  float out_[kBlockSize * 2];
+  float envelope_[kBlockSize];
+};
+
+template<int32_t num_channels, GrainQuality quality>
+void MeasureGrainOverlapAdd(const char* variant) {
+  GrainOverlapAdd<num_channels, quality> kernel;
+  kernel.Init();
+  Measure("Grain::OverlapAdd", variant, &kernel);
+}
+
+// Whole processor in granular mode, with as many grains as it can play. In
+// builds made with GRAIN_THREADS, the grains are rendered on a pool of
+// num_workers threads.
+class GranularProcessorProcess {
+ public:
+  void Init(int32_t num_workers) {
+    processor_.Init(
+        &large_buffer_[0], sizeof(large_buffer_),
+        &small_buffer_[0], sizeof(small_buffer_));
+#ifdef GRAIN_THREADS
+    worker_pool_.Init(num_workers);
+    processor_.set_worker_pool(&worker_pool_);
+#endif  // GRAIN_THREADS
+    processor_.set_num_channels(2);
+    processor_.set_low_fidelity(false);
+    processor_.set_playback_mode(PLAYBACK_MODE_GRANULAR);
+    processor_.Prepare();
+
+    Parameters* p = processor_.mutable_parameters();
+    memset(p, 0, sizeof(Parameters));
+    p->position = 0.3f;
+    p->size = 0.9f;
+    p->pitch = 7.0f;
+    p->density = 1.0f;
+    p->texture = 0.5f;
+    p->dry_wet = 1.0f;
+    p->stereo_spread = 0.5f;
+    for (size_t i = 0; i < kBlockSize * 2 * kNumBlocks; ++i) {
+      input_[i] = Random::GetSample() >> 1;
+    }
+    // Fill the recording, and let the number of grains settle.
+    for (size_t i = 0; i < 8; ++i) {
+      Run();
+    }
+  }
+
+  void Done() {
+#ifdef GRAIN_THREADS
+    worker_pool_.Done();
+#endif  // GRAIN_THREADS
+  }
+
+  void Prepare() { }
+
+  void Run() {
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+      processor_.Process(
+          &input_[i * kBlockSize * 2],
+          &output_[0],
+          kBlockSize,
+          1);
+      processor_.Prepare();
+    }
+    sink = output_[0];
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks; }
+
+ private:
+  uint8_t large_buffer_[118784];
+  uint8_t small_buffer_[65536 - 128];
+  GranularProcessor processor_;
+#ifdef GRAIN_THREADS
+  WorkerPool worker_pool_;
+#endif  // GRAIN_THREADS
+  short input_[kBlockSize * 2 * kNumBlocks];
+  short output_[kBlockSize * 2];
+};
+
+void MeasureGranularProcessor(int32_t num_workers) {
+  static GranularProcessorProcess kernel;
+  kernel.Init(num_workers);
+  char variant[64];
+  if (num_workers == 1) {
+    sprintf(variant, "dense_grains/serial");
+  } else {
+    sprintf(variant, "dense_grains/%d_workers", num_workers);
+  }
+  Measure("GranularProcessor::Process", variant, &kernel);
+  kernel.Done();
+}
+
+// -----------------------------------------------------------------------------
+//
+// Correlator.
+
+class CorrelatorCandidates {
+ public:
+  // Random sign bits get the full search, the signs of a tone with a period
+  // of 73.3 samples a search restricted to the correlation peaks.
+  void Init(bool tonal) {
+    for (size_t i = 0; i < kNumWords * 3; ++i) {
+      data_[i] = tonal ? 0 : Random::GetWord();
+    }
+    if (tonal) {
+      for (size_t i = 0; i < kWindowSize * 3; ++i) {
+        size_t bit = i < kWindowSize ? i : i - kWindowSize + kNumWords * 32;
+        float phase = (i < kWindowSize ? i + 500 : i - kWindowSize) / 73.3f;
+        if (sinf(phase * 2.0f * M_PI) > 0.0f) {
+          data_[bit >> 5] |= 0x80000000 >> (bit & 0x1f);
+        }
+      }
+    }
+    correlator_.Init(&data_[0], &data_[kNumWords]);
+  }
+
+  void Prepare() {
+    correlator_.StartSearch(kWindowSize, 0, 65536);
+  }
+
+  void Run() {
+    while (!correlator_.done()) {
+      correlator_.EvaluateNextCandidate();
+    }
+    sink = correlator_.best_match();
+  }
+
+  // Each candidate compares kWindowSize sign bits.
+  size_t num_samples() const { return kWindowSize * kWindowSize; }
+
+ private:
+  static const size_t kWindowSize = 1024;
+  static const size_t kNumWords = kWindowSize / 32 + 2;
+
+  uint32_t data_[kNumWords * 3];
+  Correlator correlator_;
+};
+
+// -----------------------------------------------------------------------------
+//
+// Phase vocoder.
+
+const size_t kFftSize = 4096;
+const size_t kHopSize = kFftSize / 4;
+
+class STFTBuffer {
+ public:
+  STFTBuffer()
+      : fft_buffer_(kFftSize),
+        ifft_buffer_(kFftSize),
+        ana_syn_buffer_((kFftSize + kHopSize) * 2),
+        input_(kHopSize),
+        output_(kHopSize) { }
+
+  void Init() {
+    stft_.Init(
+        &fft_, kFftSize, kHopSize,
+        &fft_buffer_[0], &ifft_buffer_[0],
+        lut_sine_window_4096,
+        &ana_syn_buffer_[0],
+        NULL);
+    memset(&parameters_, 0, sizeof(parameters_));
+    for (size_t i = 0; i < kHopSize; ++i) {
+      input_[i] = Noise() * 0.5f;
+    }
+  }
+
+  void Prepare() {
+    stft_.Process(parameters_, &input_[0], &output_[0], kHopSize, 1);
+  }
+
+  void Run() {
+    stft_.Buffer();
+    sink = ifft_buffer_[0];
+  }
+
+  size_t num_samples() const { return kHopSize; }
+
+ private:
+  FFT fft_;
+  vector<float> fft_buffer_;
+  vector<float> ifft_buffer_;
+  vector<short> ana_syn_buffer_;
+  vector<float> input_;
+  vector<float> output_;
+  Parameters parameters_;
+  STFT stft_;
+};
+
+template<typename T>
+class ModifierProcess {
+ public:
+  ModifierProcess()
+      : spectrum_(kFftSize),
+        fft_out_(kFftSize),
+        ifft_in_(kFftSize) { }
+
+  T* Init() {
+    size_t texture_size = modifier_.texture_size(kFftSize);
+    size_t num_textures = modifier_.num_textures();
+    textures_.resize(texture_size * num_textures);
+    modifier_.Init(&textures_[0], kFftSize, num_textures, 32000.0f, &fft_);
+    for (size_t i = 0; i < kFftSize; ++i) {
+      spectrum_[i] = Noise() * 100.0f;
+    }
+    memset(&parameters_, 0, sizeof(parameters_));
+    parameters_.position = 0.3f;
+    parameters_.size = 0.5f;
+    parameters_.pitch = 5.0f;
+    parameters_.density = 0.7f;
+    parameters_.texture = 0.6f;
+    parameters_.spectral.quantization = 0.6f;
+    parameters_.spectral.refresh_rate = 0.7f;
+    parameters_.spectral.phase_randomization = 0.2f;
+    parameters_.spectral.warp = 0.5f;
+    return &modifier_;
+  }
+
+  void Prepare() {
+    // The modifier works in place on its input.
+    copy(spectrum_.begin(), spectrum_.end(), fft_out_.begin());
+  }
+
+  void Run() {
+    modifier_.Process(parameters_, &fft_out_[0], &ifft_in_[0], false);
+    sink = ifft_in_[1];
+  }
+
+  size_t num_samples() const { return kHopSize; }
+
+ private:
+  FFT fft_;
+  T modifier_;
+  vector<float> textures_;
+  vector<float> spectrum_;
+  vector<float> fft_out_;
+  vector<float> ifft_in_;
+  Parameters parameters_;
+};
+
+// -----------------------------------------------------------------------------
+//
+// Effects.
+
+template<typename T, typename Memory>
+class FxProcess {
+ public:
+  FxProcess() : memory_(kMemorySize) { }
+
+  T* Init() {
+    fx_.Init(&memory_[0]);
+    for (size_t i = 0; i < kBlockSize * kNumBlocks; ++i) {
+      input_[i].l = Noise() * 0.5f;
+      input_[i].r = Noise() * 0.5f;
+    }
+    return &fx_;
+  }
+
+  void Prepare() {
+    copy(&input_[0], &input_[kBlockSize * kNumBlocks], &in_out_[0]);
+  }
+
+  void Run() {
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+      fx_.Process(&in_out_[i * kBlockSize], kBlockSize);
+    }
+    sink = in_out_[0].l;
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks; }
+
+ private:
+  static const size_t kMemorySize = 16384;
+
+  vector<Memory> memory_;
+  T fx_;
+  FloatFrame input_[kBlockSize * kNumBlocks];
+  FloatFrame in_out_[kBlockSize * kNumBlocks];
+};
+
+// Several reverbs run in the lanes of a ReverbBank. The cost is given per
+// sample of each instance, to compare with Reverb::Process.
+class ReverbBankProcess {
+ public:
+  enum {
+    kNumLanes = ReverbBank::kNumLanes
+  };
+
+  ReverbBankProcess()
+      : memory_(ReverbBank::kMemorySize * kNumLanes),
+        input_(kBlockSize * kNumBlocks * kNumLanes),
+        in_out_(kBlockSize * kNumBlocks * kNumLanes) { }
+
+  void Init() {
+    bank_.Init(&memory_[0]);
+    for (size_t i = 0; i < kNumLanes; ++i) {
+      bank_.set_amount(i, 0.5f);
+      bank_.set_input_gain(i, 0.2f);
+      bank_.set_time(i, 0.7f);
+      bank_.set_diffusion(i, 0.625f);
+      bank_.set_lp(i, 0.7f);
+    }
+    for (size_t i = 0; i < input_.size(); ++i) {
+      input_[i].l = Noise() * 0.5f;
+      input_[i].r = Noise() * 0.5f;
+    }
+  }
+
+  void Prepare() {
+    copy(input_.begin(), input_.end(), in_out_.begin());
+  }
+
+  void Run() {
+    const size_t lane_size = kBlockSize * kNumBlocks;
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+      FloatFrame* in_out[kNumLanes];
+      for (size_t j = 0; j < kNumLanes; ++j) {
+        in_out[j] = &in_out_[j * lane_size + i * kBlockSize];
+      }
+      bank_.Process(in_out, kBlockSize);
+    }
+    sink = in_out_[0].l;
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks * kNumLanes; }
+
+ private:
+  vector<uint16_t> memory_;
+  ReverbBank bank_;
+  vector<FloatFrame> input_;
+  vector<FloatFrame> in_out_;
+};
+
+// -----------------------------------------------------------------------------
+//
+// Sample rate conversion.
+
+template<typename Converter, int32_t ratio>
+class SampleRateConverterProcess {
+ public:
+  void Init() {
+    src_.Init();
+    for (size_t i = 0; i < kBlockSize * kNumBlocks; ++i) {
+      input_[i].l = Noise() * 0.5f;
+      input_[i].r = Noise() * 0.5f;
+    }
+  }
+
+  void Prepare() { }
+
+  void Run() {
+    // Block sizes as used by the processor in low fidelity mode.
+    const size_t factor = ratio < 0 ? -ratio : ratio;
+    const size_t input_size = ratio < 0 ? kBlockSize : kBlockSize / factor;
+    const size_t output_size = ratio < 0 ? kBlockSize / factor : kBlockSize;
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+      src_.Process(
+          &input_[i * input_size],
+          &output_[i * output_size],
+          input_size);
+    }
+    sink = output_[0].l;
+  }
+
+  // Samples at the full sample rate.
+  size_t num_samples() const { return kBlockSize * kNumBlocks; }
+
+ private:
+  Converter src_;
+  FloatFrame input_[kBlockSize * kNumBlocks];
+  FloatFrame output_[kBlockSize * kNumBlocks];
+};
+
+// -----------------------------------------------------------------------------
+//
+// Block kernels, for each instruction set.
+
+class SoftLimitMixKernel {
+ public:
+  void Init(const Kernels* kernels) {
+    kernels_ = kernels;
+    for (size_t i = 0; i < num_samples(); ++i) {
+      x_[i] = Noise() * 2.0f;
+      y_[i] = Noise();
+    }
+  }
+
+  void Prepare() {
+    copy(&y_[0], &y_[num_samples()], &in_out_[0]);
+  }
+
+  void Run() {
+    for (size_t i = 0; i < num_samples(); i += kBlockSize * 2) {
+      kernels_->soft_limit_mix(
+          &x_[i], 1.4f * 0.7f, 0.7f, &in_out_[i], kBlockSize * 2);
+    }
+    sink = in_out_[0];
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks * 2; }
+
+ private:
+  const Kernels* kernels_;
+  float x_[kBlockSize * kNumBlocks * 2];
+  float y_[kBlockSize * kNumBlocks * 2];
+  float in_out_[kBlockSize * kNumBlocks * 2];
+};
+
+class SoftConvertKernel {
+ public:
+  void Init(const Kernels* kernels) {
+    kernels_ = kernels;
+    for (size_t i = 0; i < num_samples(); ++i) {
+      in_[i] = Noise() * 2.0f;
+    }
+  }
+
+  void Prepare() { }
+
+  void Run() {
+    for (size_t i = 0; i < num_samples(); i += kBlockSize * 2) {
+      kernels_->soft_convert(&in_[i], &out_[i], kBlockSize * 2);
+    }
+    sink = out_[0];
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks * 2; }
+
+ private:
+  const Kernels* kernels_;
+  float in_[kBlockSize * kNumBlocks * 2];
+  short out_[kBlockSize * kNumBlocks * 2];
+};
+
+// Sets not supported by the CPU are reported without a cycle count.
+void MeasureKernels() {
+  for (int32_t i = 0; i < KERNEL_SET_LAST; ++i) {
+    KernelSet set = static_cast<KernelSet>(i);
+    const Kernels& kernels = GetKernels(set);
+    if (!KernelSetSupported(set)) {
+      fprintf(output, "SoftLimitMixBlock,%s,,,\n", kernels.name);
+      fprintf(output, "SoftConvertBlock,%s,,,\n", kernels.name);
+      continue;
+    }
+    SoftLimitMixKernel soft_limit_mix;
+    soft_limit_mix.Init(&kernels);
+    Measure("SoftLimitMixBlock", kernels.name, &soft_limit_mix);
+
+    SoftConvertKernel soft_convert;
+    soft_convert.Init(&kernels);
+    Measure("SoftConvertBlock", kernels.name, &soft_convert);
+  }
+}
+
+// -----------------------------------------------------------------------------
+//
+// Round-trip latency.
+
+// Simulates the circular DMA transfers of the codec. At each half-transfer
+// interrupt, the half of the RX buffer that has just been received is
+// processed into the same half of the TX buffer, which is sent once the other
+// half has been played. The delay between an impulse at the input and its
+// first appearance at the output is reported in the samples column, without
+// a cycle count.
+void MeasureRoundTripLatency(size_t block_size) {
+  static uint8_t large_buffer[118784];
+  static uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor;
+  processor.Init(
+      &large_buffer[0], sizeof(large_buffer),
+      &small_buffer[0], sizeof(small_buffer));
+  processor.set_num_channels(2);
+  processor.set_low_fidelity(false);
+  processor.set_playback_mode(PLAYBACK_MODE_LOOPING_DELAY);
+  processor.Prepare();
+
+  Parameters* p = processor.mutable_parameters();
+  memset(p, 0, sizeof(Parameters));
+  p->size = 0.5f;
+  p->texture = 0.5f;
+
+  vector<short> rx(block_size * 2 * 2, 0);
+  vector<short> tx(block_size * 2 * 2, 0);
+  const size_t impulse_time = 1000;
+  size_t latency = 0;
+  for (size_t t = 0; t < 32000 && !latency; ++t) {
+    size_t half = (t / block_size) % 2;
+    size_t offset = (half * block_size + t % block_size) * 2;
+    if (t > impulse_time && tx[offset] > 1024) {
+      latency = t - impulse_time;
+    }
+    rx[offset] = rx[offset + 1] = t == impulse_time ? 16384 : 0;
+    if ((t + 1) % block_size == 0) {
+      processor.Process(
+          &rx[half * block_size * 2],
+          &tx[half * block_size * 2],
+          block_size,
+          1);
+      processor.Prepare();
+    }
+  }
+  char variant[64];
+  sprintf(variant, "block_%lu", static_cast<unsigned long>(block_size));
+  fprintf(
+      output,
+      "RoundTripLatency,%s,%lu,,\n",
+      variant,
+      static_cast<unsigned long>(latency));
+  fflush(output);
+}
+
+// -----------------------------------------------------------------------------
+//
+// Mu-law codec.
+
+class MuLawEncode {
+ public:
+  void Init() {
+    for (size_t i = 0; i < num_samples(); ++i) {
+      pcm_[i] = Random::GetSample();
+    }
+  }
+
+  void Prepare() { }
+
+  void Run() {
+    for (size_t i = 0; i < num_samples(); ++i) {
+      encoded_[i] = Lin2MuLaw(pcm_[i]);
+    }
+    sink = encoded_[0];
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks; }
+
+ private:
+  int16_t pcm_[kBlockSize * kNumBlocks];
+  uint8_t encoded_[kBlockSize * kNumBlocks];
+};
+
+class MuLawDecode {
+ public:
+  void Init() {
+    for (size_t i = 0; i < num_samples(); ++i) {
+      encoded_[i] = Random::GetWord();
+    }
+  }
+
+  void Prepare() { }
+
+  void Run() {
+    for (size_t i = 0; i < num_samples(); ++i) {
+      pcm_[i] = MuLaw2Lin(encoded_[i]);
+    }
+    sink = pcm_[0];
+  }
+
+  size_t num_samples() const { return kBlockSize * kNumBlocks; }
+
+ private:
+  uint8_t encoded_[kBlockSize * kNumBlocks];
+  int16_t pcm_[kBlockSize * kNumBlocks];
+};
+
+int main(int argc, char** argv) {
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+  output = argc > 1 ? fopen(argv[1], "w") : stdout;
+  if (!output) {
+    return 1;
+  }
+  fprintf(output, "kernel,variant,samples,cycles,cycles_per_sample\n");
+
+  MeasureAudioBufferRead<RESOLUTION_16_BIT>("16_bit");
+  MeasureAudioBufferRead<RESOLUTION_8_BIT>("8_bit");
+  MeasureAudioBufferRead<RESOLUTION_8_BIT_DITHERED>("8_bit_dithered");
+  MeasureAudioBufferRead<RESOLUTION_8_BIT_MU_LAW>("8_bit_mu_law");
+  MeasureAudioBufferRead<RESOLUTION_32_BIT_FLOAT>("32_bit_float");
+
+  MeasureAudioBufferWrite<RESOLUTION_16_BIT>("16_bit");
+  MeasureAudioBufferWrite<RESOLUTION_8_BIT>("8_bit");
+  MeasureAudioBufferWrite<RESOLUTION_8_BIT_DITHERED>("8_bit_dithered");
+  MeasureAudioBufferWrite<RESOLUTION_8_BIT_MU_LAW>("8_bit_mu_law");
+  MeasureAudioBufferWrite<RESOLUTION_32_BIT_FLOAT>("32_bit_float");
+
+  MeasureGrainOverlapAdd<1, GRAIN_QUALITY_LOW>("mono/low");
+  MeasureGrainOverlapAdd<1, GRAIN_QUALITY_MEDIUM>("mono/medium");
+  MeasureGrainOverlapAdd<1, GRAIN_QUALITY_HIGH>("mono/high");
+  MeasureGrainOverlapAdd<2, GRAIN_QUALITY_LOW>("stereo/low");
+  MeasureGrainOverlapAdd<2, GRAIN_QUALITY_MEDIUM>("stereo/medium");
+  MeasureGrainOverlapAdd<2, GRAIN_QUALITY_HIGH>("stereo/high");
+
+  // The speedup of the threaded rendering, at the block size of the module.
+  MeasureGranularProcessor(1);
+#ifdef GRAIN_THREADS
+  MeasureGranularProcessor(2);
+  MeasureGranularProcessor(4);
+#endif  // GRAIN_THREADS
+
+  CorrelatorCandidates correlator;
+  correlator.Init(false);
+  Measure("Correlator::EvaluateNextCandidate", "1024/noise", &correlator);
+  correlator.Init(true);
+  Measure("Correlator::EvaluateNextCandidate", "1024/tonal", &correlator);
+
+  STFTBuffer stft;
+  stft.Init();
+  Measure("STFT::Buffer", "4096", &stft);
+
+  ModifierProcess<FrameTransformation> frame_transformation;
+  frame_transformation.Init();
+  Measure("Modifier::Process", "frame_transformation", &frame_transformation);
+  frame_transformation.Init()->set_crossover(512);
+  Measure(
+      "Modifier::Process",
+      "frame_transformation/crossover_512",
+      &frame_transformation);
+
+  ModifierProcess<SpectralCloudsTransformation> spectral_clouds;
+  spectral_clouds.Init();
+  Measure("Modifier::Process", "spectral_clouds", &spectral_clouds);
+
+  FxProcess<Reverb, uint16_t> reverb;
+  Reverb* r = reverb.Init();
+  r->set_amount(0.5f);
+  r->set_input_gain(0.2f);
+  r->set_time(0.7f);
+  r->set_diffusion(0.625f);
+  r->set_lp(0.7f);
+  Measure("Reverb::Process", "", &reverb);
+
+  ReverbBankProcess reverb_bank;
+  reverb_bank.Init();
+  Measure("ReverbBank::Process", "8_lanes", &reverb_bank);
+
+  FxProcess<Oliverb, uint16_t> oliverb;
+  Oliverb* o = oliverb.Init();
+  o->set_size(0.5f);
+  o->set_decay(0.7f);
+  o->set_mod_amount(100.0f);
+  o->set_mod_rate(0.3f);
+  o->set_ratio(1.5f);
+  Measure("Oliverb::Process", "", &oliverb);
+
+  FxProcess<Diffuser, float> diffuser;
+  diffuser.Init()->set_amount(0.5f);
+  Measure("Diffuser::Process", "", &diffuser);
+
+  FxProcess<PitchShifter, uint16_t> pitch_shifter;
+  PitchShifter* p = pitch_shifter.Init();
+  p->set_ratio(1.5f);
+  p->set_size(0.5f);
+  p->set_dry_wet(1.0f);
+  Measure("PitchShifter::Process", "", &pitch_shifter);
+
+  FxProcess<Resonestor, float> resonestor;
+  Resonestor* s = resonestor.Init();
+  s->set_chord(0.5f);
+  s->set_damp(0.5f);
+  s->set_narrow(0.01f);
+  s->set_feedback(0.5f);
+  s->set_harmonicity(0.8f);
+  Measure("Resonestor::Process", "", &resonestor);
+
+  SampleRateConverterProcess<
+      SampleRateConverter<-2, 45, src_filter_1x_2_45>, -2> src_down;
+  src_down.Init();
+  Measure("SampleRateConverter::Process", "down", &src_down);
+
+  SampleRateConverterProcess<
+      SampleRateConverter<+2, 45, src_filter_1x_2_45>, +2> src_up;
+  src_up.Init();
+  Measure("SampleRateConverter::Process", "up", &src_up);
+
+  SampleRateConverterProcess<
+      IirSampleRateConverter<-2, 4, src_filter_iir_2_4>, -2> iir_src_down;
+  iir_src_down.Init();
+  Measure("IirSampleRateConverter::Process", "down", &iir_src_down);
+
+  SampleRateConverterProcess<
+      IirSampleRateConverter<+2, 4, src_filter_iir_2_4>, +2> iir_src_up;
+  iir_src_up.Init();
+  Measure("IirSampleRateConverter::Process", "up", &iir_src_up);
+
+  MeasureKernels();
+
+  MuLawEncode encode;
+  encode.Init();
+  Measure("Lin2MuLaw", "", &encode);
+
+  MuLawDecode decode;
+  decode.Init();
+  Measure("MuLaw2Lin", "", &decode);
+
+  for (size_t block_size = 8; block_size <= kBlockSize; block_size *= 2) {
+    MeasureRoundTripLatency(block_size);
+  }
+
+  if (output != stdout) {
+    fclose(output);
+  }
+  return 0;
+}
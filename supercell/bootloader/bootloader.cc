@@ -25,6 +25,8 @@
 #include "stmlib/system/bootloader_utils.h"
 #include "stmlib/system/system_clock.h"
 
+#include "supercell/bootloader/modulation.h"
+#include "supercell/bootloader/update_receiver.h"
 #include "supercell/drivers/codec.h"
 #include "supercell/drivers/leds.h"
 #include "supercell/drivers/switches.h"
@@ -41,11 +43,6 @@ using namespace clouds;
 using namespace stmlib;
 using namespace stm_audio_bootloader;
 
-const double kSampleRate = 48000.0;
-const double kModulationRate = 6000.0;
-const double kBitRate = 12000.0;
-const uint32_t kStartAddress = 0x08008000;
-
 Codec codec;
 Meter meter;
 Leds leds;
@@ -166,58 +163,43 @@ void SysTick_Handler() {
 
 }
 
-size_t discard_samples = 8000;
-void FillBuffer(Codec::Frame* input, Codec::Frame* output, size_t n) {
-  meter.Process(input, n);
+size_t discard_samples = kNumDiscardedSamples;
+void FillBuffer(short* input, short* output, size_t n, size_t stride) {
+  meter.Process(input, n, stride);
   while (n--) {
-    int32_t sample = (input->l >> 4) + 2048;
+    int32_t sample = (input[0] >> 4) + 2048;
     if (!discard_samples) {
       demodulator.PushSample(sample);
     } else {
       --discard_samples;
     }
-    *output = *input;
-    ++output;
-    ++input;
+    output[0] = input[0];
+    output[stride] = input[stride];
+    output += 2 * stride;
+    input += 2 * stride;
   }
 }
 
-static size_t current_address;
-static uint16_t packet_index;
-static uint32_t kSectorBaseAddress[] = {
-  0x08000000,
-  0x08004000,
-  0x08008000,
-  0x0800C000,
-  0x08010000,
-  0x08020000,
-  0x08040000,
-  0x08060000,
-  0x08080000,
-  0x080A0000,
-  0x080C0000,
-  0x080E0000
-};
-const uint32_t kBlockSize = 16384;
-const uint16_t kPacketsPerBlock = kBlockSize / kPacketSize;
-uint8_t rx_buffer[kBlockSize];
-
-void ProgramPage(const uint8_t* data, size_t size) {
-  FLASH_Unlock();
-  FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | 
-                  FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR|FLASH_FLAG_PGSERR); 
-  for (int32_t i = 0; i < 12; ++i) {
-    if (current_address == kSectorBaseAddress[i]) {
-      FLASH_EraseSector(i * 8, VoltageRange_3);
-    }
+struct InternalFlash {
+  void Unlock() {
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | 
+                    FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR|FLASH_FLAG_PGSERR); 
   }
-  const uint32_t* words = static_cast<const uint32_t*>(
-      static_cast<const void*>(data));
-  for (size_t written = 0; written < size; written += 4) {
-    FLASH_ProgramWord(current_address, *words++);
-    current_address += 4;
+  
+  void EraseSector(int32_t sector) {
+    FLASH_EraseSector(sector * 8, VoltageRange_3);
   }
-}
+  
+  void ProgramWord(uint32_t address, uint32_t word) {
+    FLASH_ProgramWord(address, word);
+  }
+};
+
+// One block is being received while the other one is being programmed.
+uint8_t rx_buffer[2][kBlockSize];
+InternalFlash flash;
+UpdateReceiver<InternalFlash> receiver;
 
 void Init() {
   System sys;
@@ -241,8 +223,7 @@ void InitializeReception() {
       2.0 * kSampleRate / kBitRate);
   demodulator.SyncCarrier(true);
   decoder.Reset();
-  current_address = kStartAddress;
-  packet_index = 0;
+  receiver.Init(&flash, kStartAddress, &rx_buffer[0][0], kBlockSize);
   ui_state = UI_STATE_WAITING;
 }
 
@@ -261,6 +242,7 @@ int main(void) {
       error = true;
     } else {
       demodulator.ProcessAtLeast(32);
+      receiver.Step(kFlashWordsPerSlice);
     }
     
     while (demodulator.available() && !error && !exit_updater) {
@@ -269,29 +251,40 @@ int main(void) {
       switch (state) {
         case PACKET_DECODER_STATE_OK:
           {
-            ui_state = UI_STATE_RECEIVING;
-            memcpy(
-                rx_buffer + (packet_index % kPacketsPerBlock) * kPacketSize,
+            // The decompressed blocks are programmed in slices while the
+            // next packets are received. The carrier has to be acquired again
+            // after the blank that follows every transmitted block, and after
+            // a sector erase.
+            bool resync = receiver.ProcessPacket(
                 decoder.packet_data(),
                 kPacketSize);
-            ++packet_index;
-            if ((packet_index % kPacketsPerBlock) == 0) {
-              ui_state = UI_STATE_WRITING;
-              ProgramPage(rx_buffer, kBlockSize);
-              decoder.Reset();
+            ui_state = receiver.busy() ? UI_STATE_WRITING : UI_STATE_RECEIVING;
+            decoder.Reset();
+            if (receiver.error()) {
+              error = true;
+            } else if (resync) {
               demodulator.SyncCarrier(false);
             } else {
-              decoder.Reset();
               demodulator.SyncDecision();
             }
           }
           break;
         case PACKET_DECODER_STATE_ERROR_SYNC:
         case PACKET_DECODER_STATE_ERROR_CRC:
-          error = true;
+          if (receiver.expects_errors()) {
+            // Filler packet cut by the erase of the sectors.
+            decoder.Reset();
+            demodulator.SyncCarrier(false);
+          } else {
+            error = true;
+          }
           break;
         case PACKET_DECODER_STATE_END_OF_TRANSMISSION:
-          exit_updater = true;
+          if (receiver.complete()) {
+            exit_updater = true;
+          } else {
+            error = true;
+          }
           break;
         default:
           break;
@@ -304,6 +297,7 @@ int main(void) {
       InitializeReception();
     }
   }
+  receiver.Flush();
   codec.Stop();
   Uninitialize();
   JumpTo(kStartAddress);
@@ -0,0 +1,141 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Programs the received firmware blocks into the internal flash in small
+// slices, so that demodulation can go on while a block is being written.
+
+#ifndef CLOUDS_BOOTLOADER_FLASH_WRITER_H_
+#define CLOUDS_BOOTLOADER_FLASH_WRITER_H_
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+const int32_t kNumFlashSectors = 12;
+const uint32_t kFlashSectorBaseAddress[kNumFlashSectors] = {
+  0x08000000,
+  0x08004000,
+  0x08008000,
+  0x0800C000,
+  0x08010000,
+  0x08020000,
+  0x08040000,
+  0x08060000,
+  0x08080000,
+  0x080A0000,
+  0x080C0000,
+  0x080E0000
+};
+
+// Programming a word takes about 16us: a slice keeps the main loop away from
+// the demodulator for about 1ms.
+const size_t kFlashWordsPerSlice = 64;
+
+// The Flash class provides Unlock(), EraseSector(sector) and
+// ProgramWord(address, word). On the module, it wraps the STM32F4 flash
+// driver; the tests use a simulated flash memory.
+template<typename Flash>
+class FlashWriter {
+ public:
+  FlashWriter() { }
+  ~FlashWriter() { }
+
+  void Init(Flash* flash, uint32_t start_address) {
+    flash_ = flash;
+    address_ = start_address;
+    erased_end_ = start_address;
+    words_ = NULL;
+    num_words_ = 0;
+  }
+
+  // Erases, in one go, all the sectors starting in the next size bytes.
+  // Write() will not erase them again. This stalls the CPU for as long as
+  // all the erases take.
+  void Erase(uint32_t size) {
+    Flush();
+    flash_->Unlock();
+    for (int32_t i = 0; i < kNumFlashSectors; ++i) {
+      if (kFlashSectorBaseAddress[i] >= address_ &&
+          kFlashSectorBaseAddress[i] - address_ < size) {
+        flash_->EraseSector(i);
+      }
+    }
+    erased_end_ = address_ + size;
+  }
+
+  // Finishes writing the previous block, erases the sector starting at the
+  // current address (if any, and if it has not been erased by Erase()), and
+  // queues the block for programming. The block must not be modified until
+  // the next call to Write() or Flush(). Returns true if a sector has been
+  // erased: since the CPU cannot read from the flash during an erase, the
+  // incoming audio samples have been lost.
+  bool Write(const uint8_t* data, size_t size) {
+    Flush();
+    flash_->Unlock();
+    bool erased = false;
+    for (int32_t i = 0; i < kNumFlashSectors; ++i) {
+      if (address_ == kFlashSectorBaseAddress[i] && address_ >= erased_end_) {
+        flash_->EraseSector(i);
+        erased = true;
+      }
+    }
+    words_ = static_cast<const uint32_t*>(static_cast<const void*>(data));
+    num_words_ = size / 4;
+    return erased;
+  }
+
+  // Programs at most max_words words of the pending block.
+  void Step(size_t max_words) {
+    if (max_words > num_words_) {
+      max_words = num_words_;
+    }
+    num_words_ -= max_words;
+    while (max_words--) {
+      flash_->ProgramWord(address_, *words_++);
+      address_ += 4;
+    }
+  }
+
+  inline void Flush() {
+    Step(num_words_);
+  }
+
+  inline bool busy() const { return num_words_ != 0; }
+  inline uint32_t address() const { return address_; }
+
+ private:
+  Flash* flash_;
+  uint32_t address_;
+  uint32_t erased_end_;
+  const uint32_t* words_;
+  size_t num_words_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlashWriter);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_BOOTLOADER_FLASH_WRITER_H_
@@ -0,0 +1,176 @@
+#!/usr/bin/python
+#
+# Copyright 2014 Emilie Gillet.
+#
+# Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+# 
+# See http://creativecommons.org/licenses/MIT/ for more information.
+#
+# -----------------------------------------------------------------------------
+#
+# LZ compression of firmware images, decoded by the bootloader while the
+# update is being received (see lz_decoder.h for the format).
+#
+# The decompressed blocks do not line up with the blanks the encoder leaves
+# for the sector erases, so the bootloader erases all the sectors of the image
+# after the header. The header is sent in its own packet, followed by enough
+# filler packets to cover the erase. Their number is stored in the header, so
+# that the bootloader can keep track of the blanks left after every block even
+# if some of them are lost.
+
+import math
+import optparse
+import struct
+import sys
+import zlib
+
+WINDOW_SIZE = 4096
+MIN_MATCH_LENGTH = 3
+MAX_MATCH_LENGTH = 18
+MAX_CHAIN_LENGTH = 256
+
+HEADER_SIZE = 16
+
+# See modulation.h. The encoder leaves a blank after every block.
+BLOCK_SIZE = 16384
+
+# See flash_writer.h and modulation.h.
+START_ADDRESS = 0x08008000
+FLASH_SECTOR_BASE_ADDRESSES = [
+    0x08000000, 0x08004000, 0x08008000, 0x0800C000,
+    0x08010000, 0x08020000, 0x08040000, 0x08060000,
+    0x08080000, 0x080A0000, 0x080C0000, 0x080E0000, 0x08100000]
+
+# Maximum erase times from the STM32F4 datasheet, for 16k, 64k and 128k
+# sectors.
+def sector_erase_time(size):
+  return 0.5 if size <= 16384 else (1.1 if size <= 65536 else 2.0)
+
+
+def erase_time(size):
+  total = 0.0
+  end = START_ADDRESS + size
+  for start, next_start in zip(FLASH_SECTOR_BASE_ADDRESSES,
+                               FLASH_SECTOR_BASE_ADDRESSES[1:]):
+    if start >= START_ADDRESS and start < end:
+      total += sector_erase_time(next_start - start)
+  return total
+
+
+def num_filler_packets(size, bit_rate, packet_size):
+  packet_duration = packet_size * 8.0 / bit_rate
+  # One more packet for the one cut by the end of the erase, and one for the
+  # carrier resynchronization.
+  return int(math.ceil(erase_time(size) / packet_duration)) + 2
+
+
+def find_match(data, position, chains):
+  key = bytes(data[position:position + MIN_MATCH_LENGTH])
+  best_length = 0
+  best_distance = 0
+  max_length = min(MAX_MATCH_LENGTH, len(data) - position)
+  for candidate in reversed(chains.get(key, [])[-MAX_CHAIN_LENGTH:]):
+    distance = position - candidate
+    if distance > WINDOW_SIZE:
+      break
+    length = 0
+    while length < max_length and \
+        data[candidate + length] == data[position + length]:
+      length += 1
+    if length > best_length:
+      best_length = length
+      best_distance = distance
+      if length == max_length:
+        break
+  return best_length, best_distance
+
+
+def compress(data, bit_rate, packet_size):
+  data = bytearray(data)
+  num_fillers = num_filler_packets(len(data), bit_rate, packet_size)
+  # The bootloader cannot tell how many filler packets have been lost before
+  # it receives data, which must thus start before the end of the first block.
+  assert 1 + num_fillers < BLOCK_SIZE // packet_size
+  output = bytearray(struct.pack(
+      '<4sIII', b'CLZ2', len(data), zlib.crc32(bytes(data)) & 0xffffffff,
+      num_fillers))
+  output += b'\xff' * (packet_size - HEADER_SIZE)
+  output += b'\xff' * (num_fillers * packet_size)
+  data_start = len(output)
+  chains = {}
+  position = 0
+  while position < len(data):
+    flags_index = len(output)
+    output.append(0)
+    for i in range(8):
+      if position >= len(data):
+        break
+      length, distance = 0, 0
+      if position + MIN_MATCH_LENGTH <= len(data):
+        length, distance = find_match(data, position, chains)
+      if length >= MIN_MATCH_LENGTH:
+        d = distance - 1
+        output.append(d & 0xff)
+        output.append(((d >> 8) & 0x0f) | ((length - MIN_MATCH_LENGTH) << 4))
+      else:
+        length = 1
+        output[flags_index] |= 1 << i
+        output.append(data[position])
+      for j in range(position, position + length):
+        key = bytes(data[j:j + MIN_MATCH_LENGTH])
+        chains.setdefault(key, []).append(j)
+      position += length
+  # The bootloader looks for the first packet which is not made of 0xff bytes.
+  # It cannot be one: it starts with literals.
+  assert not all(
+      byte == 0xff for byte in output[data_start:data_start + packet_size])
+  return output
+
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option(
+      '-b',
+      '--baud_rate',
+      dest='baud_rate',
+      type='int',
+      default=12000,
+      help='Baud rate of the transmission')
+  parser.add_option(
+      '-p',
+      '--packet_size',
+      dest='packet_size',
+      type='int',
+      default=256,
+      help='Packet size in bytes')
+  options, args = parser.parse_args()
+  if len(args) != 2:
+    sys.exit('Usage: lz_compress.py [-b baud_rate] [-p packet_size] '
+             'input.bin output.bin')
+  data = open(args[0], 'rb').read()
+  compressed = compress(data, options.baud_rate, options.packet_size)
+  open(args[1], 'wb').write(compressed)
+  print('%s: %d -> %d bytes (%.1f%%)' % (
+      args[0], len(data), len(compressed), 100.0 * len(compressed) / len(data)))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,261 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Streaming decoder for the LZ-compressed firmware images produced by
+// lz_compress.py. The stream starts with a 16 bytes header (magic, size and
+// CRC32 of the decompressed data, number of filler packets), alone in the
+// first packet. It is followed by the filler packets made of 0xff bytes, sent
+// while the bootloader erases the flash, then by groups of 8 tokens, each
+// group preceded by a flags byte (LSB first). A token is either a literal byte
+// (flag set), or a 2 bytes back-reference: 12 bits for the distance minus 1,
+// and 4 bits for the length minus 3. Images without the header are passed
+// through unchanged.
+
+#ifndef CLOUDS_BOOTLOADER_LZ_DECODER_H_
+#define CLOUDS_BOOTLOADER_LZ_DECODER_H_
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+const uint32_t kLzMagic = stmlib::FourCC<'C', 'L', 'Z', '2'>::value;
+const size_t kLzHeaderSize = 16;
+const size_t kLzWindowSize = 4096;
+const size_t kLzMinMatchLength = 3;
+
+enum LzDecoderState {
+  LZ_DECODER_STATE_HEADER,
+  LZ_DECODER_STATE_FILLER,
+  LZ_DECODER_STATE_FLAGS,
+  LZ_DECODER_STATE_TOKEN,
+  LZ_DECODER_STATE_MATCH,
+  LZ_DECODER_STATE_COPY,
+  LZ_DECODER_STATE_RAW,
+  LZ_DECODER_STATE_DONE,
+  LZ_DECODER_STATE_ERROR
+};
+
+class LzDecoder {
+ public:
+  LzDecoder() { }
+  ~LzDecoder() { }
+
+  // The decompressed data is written alternately into two blocks of
+  // block_size bytes: one is filled while the other one is being programmed,
+  // and serves as the history for back-references. block_size must be a
+  // power of two, larger than kLzWindowSize.
+  void Init(uint8_t* buffer, size_t block_size) {
+    buffer_ = buffer;
+    block_size_ = block_size;
+    mask_ = 2 * block_size - 1;
+    position_ = 0;
+    header_size_ = 0;
+    block_ready_ = false;
+    crc_ = 0xffffffff;
+    state_ = LZ_DECODER_STATE_HEADER;
+  }
+
+  // Decodes data until it has been entirely consumed, or until a block has
+  // been filled. Returns the number of bytes consumed. Nothing is decoded
+  // until the filled block has been retrieved with PopBlock(). data must
+  // start at a packet boundary, unless decoding has been interrupted by a
+  // full block.
+  size_t Process(const uint8_t* data, size_t size) {
+    size_t consumed = 0;
+    while (!block_ready_) {
+      if (state_ == LZ_DECODER_STATE_COPY) {
+        Emit(buffer_[(position_ - distance_) & mask_]);
+        if (--length_ == 0) {
+          NextToken();
+        }
+        continue;
+      }
+      if (consumed == size) {
+        break;
+      }
+      if (state_ == LZ_DECODER_STATE_FILLER) {
+        // Some filler packets may have been lost during the erase. The
+        // tokens start with the first packet that is not made of 0xff bytes,
+        // which the compressor guarantees.
+        if (IsFiller(&data[consumed], size - consumed)) {
+          consumed = size;
+          break;
+        }
+        state_ = LZ_DECODER_STATE_FLAGS;
+      }
+      uint8_t byte = data[consumed++];
+      switch (state_) {
+        case LZ_DECODER_STATE_HEADER:
+          ParseHeader(byte);
+          break;
+
+        case LZ_DECODER_STATE_FLAGS:
+          flags_ = byte;
+          num_tokens_ = 8;
+          state_ = LZ_DECODER_STATE_TOKEN;
+          break;
+
+        case LZ_DECODER_STATE_TOKEN:
+          if (flags_ & 1) {
+            Emit(byte);
+            NextToken();
+          } else {
+            match_ = byte;
+            state_ = LZ_DECODER_STATE_MATCH;
+          }
+          break;
+
+        case LZ_DECODER_STATE_MATCH:
+          distance_ = (match_ | ((byte & 0x0f) << 8)) + 1;
+          length_ = (byte >> 4) + kLzMinMatchLength;
+          if (distance_ > position_ || position_ + length_ > size_) {
+            state_ = LZ_DECODER_STATE_ERROR;
+          } else {
+            state_ = LZ_DECODER_STATE_COPY;
+          }
+          break;
+
+        case LZ_DECODER_STATE_RAW:
+          Emit(byte);
+          break;
+
+        default:
+          // Padding after the end of the image, or corrupted stream.
+          break;
+      }
+    }
+    return consumed;
+  }
+
+  inline bool block_ready() const { return block_ready_; }
+
+  // Returns the block that has just been filled. The last block of a
+  // compressed image is padded with 0xff.
+  inline const uint8_t* PopBlock() {
+    block_ready_ = false;
+    return &buffer_[(position_ - 1) & mask_ & ~(block_size_ - 1)];
+  }
+
+  inline bool compressed() const {
+    return state_ != LZ_DECODER_STATE_HEADER && state_ != LZ_DECODER_STATE_RAW;
+  }
+  inline bool done() const { return state_ == LZ_DECODER_STATE_DONE; }
+  inline bool error() const { return state_ == LZ_DECODER_STATE_ERROR; }
+  inline bool crc_ok() const { return done() && ~crc_ == expected_crc_; }
+  inline uint32_t size() const { return size_; }
+  inline bool filler() const { return state_ == LZ_DECODER_STATE_FILLER; }
+  inline uint32_t num_filler_packets() const { return num_filler_packets_; }
+
+ private:
+  void ParseHeader(uint8_t byte) {
+    header_[header_size_++] = byte;
+    if (header_size_ == 4 && Word(0) != kLzMagic) {
+      // Uncompressed image.
+      state_ = LZ_DECODER_STATE_RAW;
+      for (size_t i = 0; i < header_size_; ++i) {
+        Emit(header_[i]);
+      }
+    } else if (header_size_ == kLzHeaderSize) {
+      size_ = Word(4);
+      expected_crc_ = Word(8);
+      num_filler_packets_ = Word(12);
+      state_ = size_ ? LZ_DECODER_STATE_FILLER : LZ_DECODER_STATE_DONE;
+    }
+  }
+
+  static bool IsFiller(const uint8_t* data, size_t size) {
+    while (size--) {
+      if (*data++ != 0xff) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  inline uint32_t Word(size_t offset) const {
+    return static_cast<uint32_t>(header_[offset]) |
+        (static_cast<uint32_t>(header_[offset + 1]) << 8) |
+        (static_cast<uint32_t>(header_[offset + 2]) << 16) |
+        (static_cast<uint32_t>(header_[offset + 3]) << 24);
+  }
+
+  inline void Emit(uint8_t byte) {
+    buffer_[position_ & mask_] = byte;
+    ++position_;
+    if (state_ != LZ_DECODER_STATE_RAW) {
+      crc_ ^= byte;
+      for (size_t i = 0; i < 8; ++i) {
+        crc_ = (crc_ >> 1) ^ (0xedb88320 & -(crc_ & 1));
+      }
+    }
+    if ((position_ & (block_size_ - 1)) == 0) {
+      block_ready_ = true;
+    }
+  }
+
+  inline void NextToken() {
+    flags_ >>= 1;
+    state_ = --num_tokens_
+        ? LZ_DECODER_STATE_TOKEN
+        : LZ_DECODER_STATE_FLAGS;
+    if (position_ == size_) {
+      state_ = LZ_DECODER_STATE_DONE;
+      // Pad the last block.
+      while (position_ & (block_size_ - 1)) {
+        buffer_[position_ & mask_] = 0xff;
+        ++position_;
+        block_ready_ = true;
+      }
+    }
+  }
+
+  uint8_t* buffer_;
+  size_t block_size_;
+  uint32_t mask_;
+  uint32_t position_;
+
+  uint8_t header_[kLzHeaderSize];
+  size_t header_size_;
+  uint32_t size_;
+  uint32_t expected_crc_;
+  uint32_t num_filler_packets_;
+  uint32_t crc_;
+
+  LzDecoderState state_;
+  uint8_t flags_;
+  uint8_t num_tokens_;
+  uint8_t match_;
+  uint32_t distance_;
+  uint32_t length_;
+
+  bool block_ready_;
+
+  DISALLOW_COPY_AND_ASSIGN(LzDecoder);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_BOOTLOADER_LZ_DECODER_H_
@@ -0,0 +1,51 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Parameters of the QPSK firmware update signal, shared by the bootloader and
+// its host test harness. They must match the encoder settings used by the
+// "wav" rule of the firmware makefile.
+
+#ifndef CLOUDS_BOOTLOADER_MODULATION_H_
+#define CLOUDS_BOOTLOADER_MODULATION_H_
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+const double kSampleRate = 48000.0;
+const double kModulationRate = 6000.0;
+const double kBitRate = 12000.0;
+const uint32_t kStartAddress = 0x08008000;
+
+// Number of samples ignored after power-up, while the codec settles.
+const size_t kNumDiscardedSamples = 8000;
+
+// Firmware data is written to flash in blocks of this size.
+const uint32_t kBlockSize = 16384;
+
+}  // namespace clouds
+
+#endif  // CLOUDS_BOOTLOADER_MODULATION_H_
@@ -0,0 +1,372 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host harness for the QPSK firmware update receiver. Decodes a WAV file
+// produced by "make wav" with the same demodulator, packet decoder,
+// decompressor and block programming logic as the bootloader, optionally
+// after adding noise and clock drift, and reports error rates and CPU usage.
+// The samples received while the CPU is stalled by a sector erase are
+// dropped, as on the module.
+//
+// Build with "make -f supercell/bootloader/test/makefile", then run:
+// qpsk_test [-n snr_db] [-d drift_ppm] [-p payload.bin] [-r firmware.bin]
+//     update.wav
+//
+// payload.bin is the file given to the encoder (the compressed image), used
+// to count symbol errors, which is only meaningful if no filler packet has been
+// lost during the erase. firmware.bin is compared with the flash contents.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <vector>
+
+#include "stmlib/utils/random.h"
+
+#include "stm_audio_bootloader/qpsk/demodulator.h"
+#include "stm_audio_bootloader/qpsk/packet_decoder.h"
+
+#include "supercell/bootloader/modulation.h"
+#include "supercell/bootloader/test/simulated_flash.h"
+#include "supercell/bootloader/update_receiver.h"
+
+using namespace clouds;
+using namespace std;
+using namespace stmlib;
+using namespace stm_audio_bootloader;
+
+const size_t kCodecBlockSize = 32;
+
+bool ReadWav(const char* file_name, vector<float>* samples) {
+  FILE* fp = fopen(file_name, "rb");
+  if (!fp) {
+    return false;
+  }
+  char id[4];
+  uint32_t size;
+  uint16_t num_channels = 0;
+  uint16_t bits_per_sample = 0;
+  bool found_data = false;
+  if (fread(id, 4, 1, fp) != 1 || memcmp(id, "RIFF", 4) ||
+      fread(&size, 4, 1, fp) != 1 ||
+      fread(id, 4, 1, fp) != 1 || memcmp(id, "WAVE", 4)) {
+    fclose(fp);
+    return false;
+  }
+  while (!found_data && fread(id, 4, 1, fp) == 1 && fread(&size, 4, 1, fp) == 1) {
+    if (!memcmp(id, "fmt ", 4)) {
+      uint8_t format[16];
+      if (size < sizeof(format) || fread(format, sizeof(format), 1, fp) != 1) {
+        break;
+      }
+      memcpy(&num_channels, &format[2], 2);
+      memcpy(&bits_per_sample, &format[14], 2);
+      fseek(fp, size - sizeof(format), SEEK_CUR);
+    } else if (!memcmp(id, "data", 4)) {
+      found_data = true;
+    } else {
+      fseek(fp, size, SEEK_CUR);
+    }
+  }
+  if (!found_data || bits_per_sample != 16 || num_channels == 0) {
+    fclose(fp);
+    return false;
+  }
+  // Only the left channel is used, as in the bootloader.
+  vector<int16_t> frames(size / 2);
+  size_t num_read = fread(&frames[0], 2, frames.size(), fp);
+  fclose(fp);
+  samples->clear();
+  for (size_t i = 0; i + num_channels <= num_read; i += num_channels) {
+    samples->push_back(static_cast<float>(frames[i]));
+  }
+  return true;
+}
+
+// White gaussian noise, at snr_db below the RMS level of the signal.
+void AddNoise(float snr_db, vector<float>* samples) {
+  double power = 0.0;
+  for (size_t i = 0; i < samples->size(); ++i) {
+    power += (*samples)[i] * (*samples)[i];
+  }
+  power /= samples->size();
+  float sigma = sqrt(power) * powf(10.0f, -snr_db / 20.0f);
+  for (size_t i = 0; i < samples->size(); ++i) {
+    float u = 1.0f - Random::GetFloat();
+    float v = Random::GetFloat();
+    (*samples)[i] += sigma * sqrtf(-2.0f * logf(u)) * cosf(2.0f * M_PI * v);
+  }
+}
+
+// Resamples the signal as if it had been played by a device whose clock
+// runs drift_ppm faster than the one of the module.
+void AddDrift(float drift_ppm, vector<float>* samples) {
+  vector<float> resampled;
+  double step = 1.0 + drift_ppm * 1e-6;
+  for (double position = 0.0; position < samples->size() - 1; position += step) {
+    size_t integral = static_cast<size_t>(position);
+    float fractional = position - integral;
+    float a = (*samples)[integral];
+    float b = (*samples)[integral + 1];
+    resampled.push_back(a + (b - a) * fractional);
+  }
+  samples->swap(resampled);
+}
+
+int16_t ClipSample(float x) {
+  return x > 32767.0f ? 32767 : (x < -32768.0f ? -32768 : x);
+}
+
+bool ReadFile(const char* file_name, vector<uint8_t>* data) {
+  FILE* fp = fopen(file_name, "rb");
+  if (!fp) {
+    return false;
+  }
+  uint8_t buffer[1024];
+  size_t num_read;
+  data->clear();
+  while ((num_read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    data->insert(data->end(), &buffer[0], &buffer[num_read]);
+  }
+  fclose(fp);
+  return true;
+}
+
+size_t CountSymbolErrors(const uint8_t* a, const uint8_t* b, size_t size) {
+  size_t errors = 0;
+  for (size_t i = 0; i < size; ++i) {
+    uint8_t difference = a[i] ^ b[i];
+    for (size_t j = 0; j < 4; ++j) {
+      errors += (difference >> (j * 2)) & 3 ? 1 : 0;
+    }
+  }
+  return errors;
+}
+
+int main(int argc, char** argv) {
+  float snr_db = 0.0f;
+  bool add_noise = false;
+  float drift_ppm = 0.0f;
+  const char* payload_file_name = NULL;
+  const char* reference_file_name = NULL;
+  int option;
+  while ((option = getopt(argc, argv, "n:d:p:r:")) != -1) {
+    switch (option) {
+      case 'n':
+        snr_db = atof(optarg);
+        add_noise = true;
+        break;
+      case 'd':
+        drift_ppm = atof(optarg);
+        break;
+      case 'p':
+        payload_file_name = optarg;
+        break;
+      case 'r':
+        reference_file_name = optarg;
+        break;
+      default:
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr,
+        "Usage: %s [-n snr_db] [-d drift_ppm] [-p payload.bin] "
+        "[-r firmware.bin] update.wav\n",
+        argv[0]);
+    return 2;
+  }
+
+  vector<float> samples;
+  if (!ReadWav(argv[optind], &samples)) {
+    fprintf(stderr, "Could not read 16-bit WAV file %s\n", argv[optind]);
+    return 2;
+  }
+  vector<uint8_t> payload;
+  if (payload_file_name && !ReadFile(payload_file_name, &payload)) {
+    fprintf(stderr, "Could not read %s\n", payload_file_name);
+    return 2;
+  }
+  vector<uint8_t> reference;
+  if (reference_file_name && !ReadFile(reference_file_name, &reference)) {
+    fprintf(stderr, "Could not read %s\n", reference_file_name);
+    return 2;
+  }
+
+  Random::Seed(0x21);
+  if (drift_ppm != 0.0f) {
+    AddDrift(drift_ppm, &samples);
+  }
+  if (add_noise) {
+    AddNoise(snr_db, &samples);
+  }
+
+  static Demodulator demodulator;
+  static PacketDecoder decoder;
+  static SimulatedFlash flash;
+  static UpdateReceiver<SimulatedFlash> receiver;
+  static uint8_t rx_buffer[2][kBlockSize];
+
+  decoder.Init(20000);
+  demodulator.Init(
+      kModulationRate / kSampleRate * 4294967296.0,
+      kSampleRate / kModulationRate,
+      2.0 * kSampleRate / kBitRate);
+  demodulator.SyncCarrier(true);
+  decoder.Reset();
+  receiver.Init(&flash, kStartAddress, &rx_buffer[0][0], kBlockSize);
+
+  size_t packet_index = 0;
+  size_t num_crc_errors = 0;
+  size_t num_sync_errors = 0;
+  size_t num_symbol_errors = 0;
+  size_t num_carrier_resyncs = 0;
+  size_t num_erase_errors = 0;
+  size_t num_dropped_samples = 0;
+  bool overflow = false;
+  bool end_of_transmission = false;
+
+  clock_t start = clock();
+  for (size_t n = kNumDiscardedSamples;
+       n + kCodecBlockSize <= samples.size() && !end_of_transmission;
+       n += kCodecBlockSize) {
+    // FillBuffer().
+    for (size_t i = 0; i < kCodecBlockSize; ++i) {
+      demodulator.PushSample((ClipSample(samples[n + i]) >> 4) + 2048);
+    }
+    if (demodulator.state() == DEMODULATOR_STATE_OVERFLOW) {
+      overflow = true;
+      break;
+    }
+
+    // Main loop.
+    demodulator.ProcessAtLeast(kCodecBlockSize);
+    receiver.Step(kFlashWordsPerSlice);
+    while (demodulator.available() && !end_of_transmission) {
+      uint8_t symbol = demodulator.NextSymbol();
+      PacketDecoderState state = decoder.ProcessSymbol(symbol);
+      bool complete_packet = false;
+      switch (state) {
+        case PACKET_DECODER_STATE_OK:
+          complete_packet = true;
+          break;
+        case PACKET_DECODER_STATE_ERROR_CRC:
+          if (receiver.expects_errors()) {
+            ++num_erase_errors;
+            decoder.Reset();
+            demodulator.SyncCarrier(false);
+            ++num_carrier_resyncs;
+            break;
+          }
+          // The bootloader gives up here. Keep going to measure the error
+          // rate over the whole transmission.
+          ++num_crc_errors;
+          complete_packet = true;
+          break;
+        case PACKET_DECODER_STATE_ERROR_SYNC:
+          if (receiver.expects_errors()) {
+            ++num_erase_errors;
+          } else {
+            ++num_sync_errors;
+          }
+          decoder.Reset();
+          demodulator.SyncCarrier(false);
+          ++num_carrier_resyncs;
+          break;
+        case PACKET_DECODER_STATE_END_OF_TRANSMISSION:
+          end_of_transmission = true;
+          break;
+        default:
+          break;
+      }
+      if (!complete_packet) {
+        continue;
+      }
+      size_t offset = packet_index * kPacketSize;
+      if (offset + kPacketSize <= payload.size()) {
+        num_symbol_errors += CountSymbolErrors(
+            decoder.packet_data(), &payload[offset], kPacketSize);
+      }
+      bool resync = receiver.ProcessPacket(decoder.packet_data(), kPacketSize);
+      ++packet_index;
+      decoder.Reset();
+      if (resync) {
+        demodulator.SyncCarrier(false);
+        ++num_carrier_resyncs;
+      } else {
+        demodulator.SyncDecision();
+      }
+    }
+    size_t stall = flash.TakeStallDuration() * kSampleRate;
+    stall -= stall % kCodecBlockSize;
+    n += stall;
+    num_dropped_samples += stall;
+  }
+  receiver.Flush();
+  double cpu_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  double duration = samples.size() / kSampleRate;
+
+  size_t num_symbols = packet_index * kPacketSize * 4;
+  printf("duration          %.1f s\n", duration);
+  printf("packets           %d\n", static_cast<int>(packet_index));
+  printf("crc errors        %d\n", static_cast<int>(num_crc_errors));
+  printf("sync errors       %d\n", static_cast<int>(num_sync_errors));
+  printf("carrier resyncs   %d\n", static_cast<int>(num_carrier_resyncs));
+  printf("erase errors      %d\n", static_cast<int>(num_erase_errors));
+  printf("dropped           %.1f s\n", num_dropped_samples / kSampleRate);
+  if (payload_file_name) {
+    printf("symbol error rate %g\n", num_symbols
+        ? static_cast<double>(num_symbol_errors) / num_symbols
+        : 1.0);
+  }
+  printf("cpu               %.3f ms per second of audio\n",
+      1000.0 * cpu_time / duration);
+  if (overflow) {
+    printf("demodulator overflow\n");
+  }
+  if (!end_of_transmission) {
+    printf("no end of transmission\n");
+  }
+  const LzDecoder& lz_decoder = receiver.lz_decoder();
+  if (lz_decoder.compressed()) {
+    printf("decompressed      %d bytes, crc %s\n",
+        static_cast<int>(lz_decoder.size()),
+        lz_decoder.crc_ok() ? "ok" : "error");
+  }
+
+  bool success = end_of_transmission && !overflow &&
+      !num_crc_errors && !num_sync_errors && receiver.complete();
+  if (reference_file_name) {
+    bool match = receiver.address() - kStartAddress >= reference.size() &&
+        !memcmp(flash.data(kStartAddress), &reference[0], reference.size());
+    printf("firmware          %s\n", match ? "ok" : "mismatch");
+    success = success && match;
+  }
+  return success ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// In-memory model of the STM32F4 flash, for host tests of the bootloader.
+
+#ifndef CLOUDS_BOOTLOADER_TEST_SIMULATED_FLASH_H_
+#define CLOUDS_BOOTLOADER_TEST_SIMULATED_FLASH_H_
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "supercell/bootloader/flash_writer.h"
+
+namespace clouds {
+
+class SimulatedFlash {
+ public:
+  SimulatedFlash()
+      : memory_(kSize, 0),
+        num_erases_(0),
+        stall_duration_(0.0f) { }
+  
+  void Unlock() { }
+  
+  void EraseSector(int32_t sector) {
+    uint32_t start = kFlashSectorBaseAddress[sector];
+    uint32_t end = sector == kNumFlashSectors - 1
+        ? kFlashSectorBaseAddress[0] + kSize
+        : kFlashSectorBaseAddress[sector + 1];
+    std::fill(
+        &memory_[0] + (start - kFlashSectorBaseAddress[0]),
+        &memory_[0] + (end - kFlashSectorBaseAddress[0]),
+        0xff);
+    ++num_erases_;
+    stall_duration_ += erase_duration(sector);
+  }
+  
+  // Maximum erase time from the STM32F4 datasheet (x32 parallelism).
+  static float erase_duration(int32_t sector) {
+    return sector < 4 ? 0.5f : (sector == 4 ? 1.1f : 2.0f);
+  }
+  
+  void ProgramWord(uint32_t address, uint32_t word) {
+    uint8_t* destination = &memory_[address - kFlashSectorBaseAddress[0]];
+    for (size_t i = 0; i < 4; ++i) {
+      // Programming can only clear bits.
+      assert(destination[i] == 0xff);
+      destination[i] = word >> (i * 8);
+    }
+  }
+  
+  const uint8_t* data(uint32_t address) const {
+    return &memory_[address - kFlashSectorBaseAddress[0]];
+  }
+  
+  size_t num_erases() const { return num_erases_; }
+  
+  // Returns the time, in seconds, during which the CPU has been stalled by
+  // erases since the previous call.
+  float TakeStallDuration() {
+    float duration = stall_duration_;
+    stall_duration_ = 0.0f;
+    return duration;
+  }
+  
+ private:
+  static const size_t kSize = 1024 * 1024;
+  std::vector<uint8_t> memory_;
+  size_t num_erases_;
+  float stall_duration_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedFlash);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_BOOTLOADER_TEST_SIMULATED_FLASH_H_
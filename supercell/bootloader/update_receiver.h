@@ -0,0 +1,133 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Feeds the packets of a firmware update to the decompressor, and programs
+// the decompressed blocks. Shared by the bootloader and its host tests.
+
+#ifndef CLOUDS_BOOTLOADER_UPDATE_RECEIVER_H_
+#define CLOUDS_BOOTLOADER_UPDATE_RECEIVER_H_
+
+#include "stmlib/stmlib.h"
+
+#include "supercell/bootloader/flash_writer.h"
+#include "supercell/bootloader/lz_decoder.h"
+
+namespace clouds {
+
+template<typename Flash>
+class UpdateReceiver {
+ public:
+  UpdateReceiver() { }
+  ~UpdateReceiver() { }
+
+  // buffer holds 2 * block_size bytes. block_size is also the size of the
+  // blocks transmitted by the encoder.
+  void Init(
+      Flash* flash,
+      uint32_t start_address,
+      uint8_t* buffer,
+      size_t block_size) {
+    flash_writer_.Init(flash, start_address);
+    lz_decoder_.Init(buffer, block_size);
+    block_size_ = block_size;
+    erased_ = false;
+    expects_errors_ = false;
+    num_received_bytes_ = 0;
+  }
+
+  // Processes a packet received without errors. Returns true if the carrier
+  // has to be acquired again: either the packet ends a block of transmitted
+  // data, after which the encoder leaves a blank, or the flash has been
+  // erased and the incoming audio samples have been lost.
+  bool ProcessPacket(const uint8_t* data, size_t size) {
+    bool erased = false;
+    bool filler = lz_decoder_.filler();
+    size_t packet_size = size;
+    expects_errors_ = false;
+    while (size) {
+      size_t consumed = lz_decoder_.Process(data, size);
+      data += consumed;
+      size -= consumed;
+      if (lz_decoder_.block_ready() &&
+          flash_writer_.Write(lz_decoder_.PopBlock(), block_size_)) {
+        erased = true;
+      }
+    }
+    if (lz_decoder_.compressed() && !erased_) {
+      // The encoder leaves a blank after every 16kB of transmitted data,
+      // which does not match the blocks of the decompressed image. Instead,
+      // all the sectors are erased after the header, while the filler
+      // packets are being sent. The packet during which the erase ends is
+      // likely to be corrupted.
+      flash_writer_.Erase(lz_decoder_.size());
+      erased_ = true;
+      expects_errors_ = true;
+      erased = true;
+    }
+    num_received_bytes_ += packet_size;
+    if (filler && !lz_decoder_.filler()) {
+      // Some of the filler packets before this one may have been lost during
+      // the erase.
+      num_received_bytes_ = packet_size * (
+          2 + lz_decoder_.num_filler_packets());
+    }
+    return erased || num_received_bytes_ % block_size_ == 0;
+  }
+
+  inline void Step(size_t max_words) { flash_writer_.Step(max_words); }
+  inline void Flush() { flash_writer_.Flush(); }
+
+  // True if sync and CRC errors can be ignored: no packet has been received
+  // since the sectors of a compressed image have been erased.
+  inline bool expects_errors() const { return expects_errors_; }
+
+  // True if the compressed image is corrupted.
+  inline bool error() const { return lz_decoder_.error(); }
+
+  // True once the end of transmission has been received, if the image is
+  // complete and valid.
+  inline bool complete() const {
+    return !lz_decoder_.compressed() || lz_decoder_.crc_ok();
+  }
+
+  inline bool busy() const { return flash_writer_.busy(); }
+  inline uint32_t address() const { return flash_writer_.address(); }
+  inline const LzDecoder& lz_decoder() const { return lz_decoder_; }
+
+ private:
+  FlashWriter<Flash> flash_writer_;
+  LzDecoder lz_decoder_;
+  size_t block_size_;
+  bool erased_;
+  bool expects_errors_;
+  size_t num_received_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(UpdateReceiver);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_BOOTLOADER_UPDATE_RECEIVER_H_
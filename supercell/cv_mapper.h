@@ -0,0 +1,134 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Hardware-independent part of the CV scaler: smoothing of the raw ADC
+// readings and mapping to the processor parameters. Runs at control rate,
+// and publishes its results to the audio interrupt through a double buffer.
+
+#ifndef CLOUDS_CV_MAPPER_H_
+#define CLOUDS_CV_MAPPER_H_
+
+#include "stmlib/stmlib.h"
+
+#include "supercell/double_buffer.h"
+#include "supercell/settings.h"
+#include "supercell/drivers/adc.h"
+#include "supercell/drivers/pots_adc.h"
+#include "supercell/dsp/parameters.h"
+
+namespace clouds {
+
+#define ADC_CHANNELS_TOTAL (ADC_CHANNEL_LAST + ADC_CHANNEL_POTENTIOMETER_LAST)
+
+struct CvTransformation {
+  bool flip;
+  bool remove_offset;
+  float filter_coefficient;
+};
+
+struct GateEvents {
+  bool freeze_rising_edge;
+  bool freeze_falling_edge;
+  bool trigger_rising_edge;
+  bool gate;
+};
+
+// What the control-rate task hands over to the audio interrupt. Triggers and
+// freeze gate edges are passed as running counts, so that they are seen
+// exactly once by the audio code whatever the relative rates of the two.
+struct ControlFrame {
+  Parameters parameters;
+  uint32_t trigger_count;
+  uint32_t freeze_edge_count;
+  bool freeze;
+};
+
+class CvMapper {
+ public:
+  CvMapper() { }
+  ~CvMapper() { }
+
+  void Init(CalibrationData* calibration_data);
+
+  // Recomputes the per-channel offsets after a calibration.
+  void UpdateOffsets();
+
+  // Control rate. values contains ADC_CHANNELS_TOTAL readings in [0, 1]:
+  // the CV ADC channels first, then the pots.
+  void Process(const float* values, const GateEvents& gates);
+
+  // Audio rate. Copies the latest published parameters.
+  void Read(Parameters* parameters);
+
+  inline void set_trigger_flag() {
+    trigger_button_flag_ = true;
+  }
+
+  inline float output_level() const {
+    return output_level_ * output_level_;
+  }
+
+  inline float smoothed_value(size_t index) const {
+    return smoothed_adc_value_[index];
+  }
+
+ private:
+  static const int kAdcLatency = 5;
+
+  CalibrationData* calibration_data_;
+  volatile bool trigger_button_flag_;
+
+  // Transformations, stored as one array per coefficient so that the
+  // smoothing of all channels runs as a single loop.
+  float scale_[ADC_CHANNELS_TOTAL];
+  float flip_offset_[ADC_CHANNELS_TOTAL];
+  float calibration_offset_[ADC_CHANNELS_TOTAL];
+  float filter_coefficient_[ADC_CHANNELS_TOTAL];
+  float smoothed_adc_value_[ADC_CHANNELS_TOTAL];
+  static CvTransformation transformations_[ADC_CHANNELS_TOTAL];
+
+  float note_;
+  float output_level_;
+
+  bool previous_trigger_[kAdcLatency];
+  bool previous_gate_[kAdcLatency];
+
+  uint32_t trigger_count_;
+  uint32_t freeze_edge_count_;
+  bool freeze_;
+
+  // Consumer side.
+  uint32_t read_trigger_count_;
+  uint32_t read_freeze_edge_count_;
+
+  DoubleBuffer<ControlFrame> frames_;
+
+  DISALLOW_COPY_AND_ASSIGN(CvMapper);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_CV_MAPPER_H_
@@ -31,6 +31,7 @@
 
 #include "stmlib/stmlib.h"
 
+#include "supercell/cv_mapper.h"
 #include "supercell/settings.h"
 #include "supercell/drivers/adc.h"
 #include "supercell/drivers/pots_adc.h"
@@ -39,21 +40,21 @@
 
 namespace clouds {
 
-#define ADC_CHANNELS_TOTAL (ADC_CHANNEL_LAST + ADC_CHANNEL_POTENTIOMETER_LAST)
-
-struct CvTransformation {
-  bool flip;
-  bool remove_offset;
-  float filter_coefficient;
-};
-
 class CvScaler {
  public:
   CvScaler() { }
   ~CvScaler() { }
   
   void Init(CalibrationData* calibration_data);
-  void Read(Parameters* parameters);
+
+  // Called from the 1kHz SysTick: scans the ADCs and gate inputs and updates
+  // the parameters.
+  void Scan();
+
+  // Called from the audio interrupt: copies the latest parameters.
+  void Read(Parameters* parameters) {
+    mapper_.Read(parameters);
+  }
   
   void CalibrateC1() {
     cv_c1_ = adc_.float_value(ADC_VOCT_CV);
@@ -63,6 +64,7 @@ class CvScaler {
     for (size_t i = 0; i < ADC_CHANNELS_TOTAL; ++i) {
       calibration_data_->offset[i] = adc_.float_value(i);
     }
+    mapper_.UpdateOffsets();
   }
   
   bool CalibrateC3() {
@@ -88,37 +90,27 @@ class CvScaler {
   }
 
   inline void set_trigger_flag() {
-    trigger_button_flag_ = true;
+    mapper_.set_trigger_flag();
   }
 
   inline float output_level() const {
-    return output_level_ * output_level_;
+    return mapper_.output_level();
     //return output_level_ < 0.5f ? (1.0f - (output_level_ * 0.667f)) * 2.6667f : 0.0f;
   }
 
   inline float pan_pot() const {
-    return smoothed_adc_value_[ADC_CHANNEL_LAST + ADC_SPREAD_POTENTIOMETER];
+    return mapper_.smoothed_value(
+        ADC_CHANNEL_LAST + ADC_SPREAD_POTENTIOMETER);
   }
 
  private:
-  static const int kAdcLatency = 5;
-  
   Adc adc_;
   PotsAdc pots_adc_;
   GateInput gate_input_;
   CalibrationData* calibration_data_;
-  bool trigger_button_flag_;
-  
-  float smoothed_adc_value_[ADC_CHANNELS_TOTAL];
-  static CvTransformation transformations_[ADC_CHANNELS_TOTAL];
+  CvMapper mapper_;
   
-  float note_;
   float cv_c1_;
-
-  float output_level_; // Added for better VU meter control.
-  
-  bool previous_trigger_[kAdcLatency];
-  bool previous_gate_[kAdcLatency];
   
   DISALLOW_COPY_AND_ASSIGN(CvScaler);
 };
@@ -0,0 +1,73 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Lock-free publication of a block of data from a producer to a consumer
+// running at a higher priority (for example, from the control-rate task to
+// the audio interrupt).
+
+#ifndef CLOUDS_DOUBLE_BUFFER_H_
+#define CLOUDS_DOUBLE_BUFFER_H_
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+template<typename T>
+class DoubleBuffer {
+ public:
+  DoubleBuffer() { }
+  ~DoubleBuffer() { }
+
+  void Init() {
+    front_ = 0;
+  }
+
+  // The producer fills the buffer that is not visible to the consumer...
+  inline T* back() {
+    return &buffers_[front_ ^ 1];
+  }
+
+  // ...then makes it visible with a single word write. Since the consumer
+  // preempts the producer and never the other way round, the consumer never
+  // observes a half-written buffer.
+  inline void Publish() {
+    front_ ^= 1;
+  }
+
+  inline const T& front() const {
+    return buffers_[front_];
+  }
+
+ private:
+  T buffers_[2];
+  volatile uint32_t front_;
+
+  DISALLOW_COPY_AND_ASSIGN(DoubleBuffer);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DOUBLE_BUFFER_H_
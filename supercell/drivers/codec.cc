@@ -545,19 +545,7 @@ void Codec::Fill(size_t offset) {
     offset *= block_size_ * stride_ * 2;
     short* in = &rx_dma_buffer_[offset];
     short* out = &tx_dma_buffer_[offset];
-    if (stride_) {
-      // Undo the padding from the WM8731.
-      for (size_t i = 1; i < block_size_ * 2; ++i) {
-        in[i] = in[i * stride_];
-      }
-    }
-    (*callback_)((Frame*)(in), (Frame*)(out), block_size_);
-    if (stride_) {
-      // Pad for the WM8731.
-      for (size_t i = block_size_ * 2 - 1; i > 0; --i) {
-        out[i * stride_] = out[i];
-      }
-    }
+    (*callback_)(in, out, block_size_, stride_);
   }
 }
 
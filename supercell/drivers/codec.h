@@ -48,7 +48,15 @@ class Codec {
     short r;
   } Frame;
   
-  typedef void (*FillBufferCallback)(Frame* rx, Frame* tx, size_t size);
+  // The callback reads and writes the DMA buffers directly. They contain
+  // interleaved stereo samples, but when the WM8731 is the master, the
+  // samples are padded: sample i (left and right alternating) is at index
+  // i * stride.
+  typedef void (*FillBufferCallback)(
+      short* rx,
+      short* tx,
+      size_t size,
+      size_t stride);
   
   bool Init(
       bool mcu_is_master,
@@ -36,10 +36,13 @@
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/utils/dsp.h"
 
+#include "supercell/dsp/chunk_index.h"
 #include "supercell/dsp/mu_law.h"
+#include "supercell/dsp/onset_index.h"
 
 const int32_t kCrossFadeSize = 256;
 const int32_t kInterpolationTail = 8;
+const int32_t kNumPyramidLevels = 2;
 
 namespace clouds {
 
@@ -48,6 +51,7 @@ enum Resolution {
   RESOLUTION_8_BIT,
   RESOLUTION_8_BIT_DITHERED,
   RESOLUTION_8_BIT_MU_LAW,
+  RESOLUTION_32_BIT_FLOAT
 };
 
 enum InterpolationMethod {
@@ -66,61 +70,125 @@ class AudioBuffer {
       void* buffer,
       int32_t size,
       int16_t* tail_buffer) {
+    Init(buffer, size, NULL, 0, tail_buffer);
+  }
+  
+  // The sample memory can be split into two non-contiguous segments, for
+  // example to extend a buffer in SRAM with some memory left in the CCM. Each
+  // segment is followed by a copy of the kInterpolationTail samples which
+  // logically follow it, so the readers never have to check for a segment
+  // boundary once they have located the first sample.
+  void Init(
+      void* buffer,
+      int32_t size,
+      void* extension,
+      int32_t extension_size,
+      int16_t* tail_buffer) {
+    if (extension_size <= kInterpolationTail) {
+      extension = NULL;
+      extension_size = 0;
+    }
     s16_ = static_cast<int16_t*>(buffer);
     s8_ = static_cast<int8_t*>(buffer);
-    size_ = size - kInterpolationTail;
+    f32_ = static_cast<float*>(buffer);
+    split_ = size - kInterpolationTail;
+    size_ = split_;
+    if (extension) {
+      size_ += extension_size - kInterpolationTail;
+      s16_extension_ = static_cast<int16_t*>(extension);
+      s8_extension_ = static_cast<int8_t*>(extension);
+      f32_extension_ = static_cast<float*>(extension);
+    } else {
+      // Without extension, the second segment is the tail of the first one
+      // and all addressing falls back to the contiguous case.
+      s16_extension_ = &s16_[split_];
+      s8_extension_ = &s8_[split_];
+      f32_extension_ = &f32_[split_];
+    }
     write_head_ = 0;
     quantization_error_ = 0.0f;
     crossfade_counter_ = 0;
     if (resolution == RESOLUTION_16_BIT) {
       std::fill(&s16_[0], &s16_[size], 0);
+      std::fill(&s16_extension_[0], &s16_extension_[extension_size], 0);
+    } else if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      std::fill(&f32_[0], &f32_[size], 0.0f);
+      std::fill(&f32_extension_[0], &f32_extension_[extension_size], 0.0f);
     } else {
-      std::fill(
-          &s8_[0],
-          &s8_[size],
-          resolution == RESOLUTION_8_BIT_MU_LAW ? 127 : 0);
+      int8_t blank = resolution == RESOLUTION_8_BIT_MU_LAW ? 127 : 0;
+      std::fill(&s8_[0], &s8_[size], blank);
+      std::fill(&s8_extension_[0], &s8_extension_[extension_size], blank);
     }
     tail_ = tail_buffer;
+    onsets_.Init(size_);
+    chunks_.Init(size_);
+    num_levels_ = 0;
+  }
+  
+  // Optionally keeps copies of the recording decimated to 1/2 and 1/4 of the
+  // sample rate, from which the players read when transposing up by more
+  // than one and two octaves. They are stored as 16-bit samples (or floats
+  // for a float buffer), and need up to 3/4 of the size of the recording
+  // at this resolution. The levels which do not fit are left out.
+  void InitPyramid(void* buffer, int32_t size_bytes) {
+    int32_t sample_size = resolution == RESOLUTION_32_BIT_FLOAT ? 4 : 2;
+    uint8_t* memory = static_cast<uint8_t*>(buffer);
+    num_levels_ = 0;
+    level_size_[0] = size_;
+    for (int32_t level = 1; level <= kNumPyramidLevels; ++level) {
+      level_size_[level] = (level_size_[level - 1] + 1) >> 1;
+      int32_t level_bytes = (level_size_[level] + kInterpolationTail) *
+          sample_size;
+      if (level_bytes > size_bytes) {
+        break;
+      }
+      level_s16_[level] = reinterpret_cast<int16_t*>(memory);
+      level_f32_[level] = reinterpret_cast<float*>(memory);
+      memory += level_bytes;
+      size_bytes -= level_bytes;
+      std::fill(memory - level_bytes, memory, 0);
+      num_levels_ = level;
+    }
+    std::fill(&history_[0][0], &history_[kNumPyramidLevels - 1][16], 0.0f);
+    std::fill(&history_ptr_[0], &history_ptr_[kNumPyramidLevels], 0);
+  }
+  
+  // Recomputes the decimated copies from the recording, for example after
+  // it has been loaded from a sample memory.
+  void RebuildPyramid() {
+    if (!num_levels_) {
+      return;
+    }
+    // Wrap around to feed the decimators with the samples following the
+    // first decimated ones.
+    for (int32_t i = 0; i < size_ + kDecimatorDelay * 4; ++i) {
+      int32_t index = i % size_;
+      Decimate(index, ReadZOH(index, 0));
+    }
+  }
+  
+  // Pyramid level from which a player moving at the given speed (16.16 fixed
+  // point) should read.
+  inline int32_t pyramid_level(int32_t phase_increment) const {
+    if (phase_increment < 0) {
+      phase_increment = -phase_increment;
+    }
+    int32_t level = 0;
+    while (level < num_levels_ && phase_increment >= (131072 << level)) {
+      ++level;
+    }
+    return level;
   }
   
   inline void Resync(int32_t head) {
     write_head_ = head;
     crossfade_counter_ = 0;
+    onsets_.Resync(head);
+    chunks_.Resync(head);
   }
   
   inline void Write(float in) {
-    if (resolution == RESOLUTION_16_BIT) {
-      s16_[write_head_] = stmlib::Clip16(
-            static_cast<int32_t>(in * 32768.0f));
-    } else if (resolution == RESOLUTION_8_BIT_DITHERED) {
-      float sample = in * 127.0f;
-      sample += quantization_error_;
-      int32_t quantized = static_cast<int32_t>(sample);
-      if (quantized < -127) quantized = -127;
-      else if (quantized > 127) quantized = 127;
-      quantization_error_ = sample - static_cast<float>(in);
-      s8_[write_head_] = quantized;
-    } else if (resolution == RESOLUTION_8_BIT_MU_LAW) {
-      int16_t sample = stmlib::Clip16(static_cast<int32_t>(in * 32768.0f));
-      s8_[write_head_] = Lin2MuLaw(sample);
-    } else {
-      s8_[write_head_] = static_cast<int8_t>(
-          stmlib::Clip16(in * 32768.0f) >> 8);
-    }
-    
-    if (resolution == RESOLUTION_16_BIT) {
-      if (write_head_ < kInterpolationTail) {
-        s16_[write_head_ + size_] = s16_[write_head_];
-      }
-    } else {
-      if (write_head_ < kInterpolationTail) {
-        s8_[write_head_ + size_] = s8_[write_head_];
-      }
-    }
-    ++write_head_;
-    if (write_head_ >= size_) {
-      write_head_ = 0;
-    }
+    WriteIndexed(&in, 1, 1, 32768.0f);
   }
   
   inline void WriteFade(
@@ -140,47 +208,30 @@ class AudioBuffer {
           }
         }
       }
-    } else if (write && !crossfade_counter_ && 
-        resolution == RESOLUTION_16_BIT &&
-        write_head_ >= kInterpolationTail && write_head_ < (size_ - size)) {
-      // Fast write routine for the most common case.
-      while (size--) {
-        s16_[write_head_] = stmlib::Clip16(
-            static_cast<int32_t>(*in * 32767.0f));
-        ++write_head_;
-        in += stride;
-      }
     } else {
-      while (size--) {
-        float sample = *in;
-        if (crossfade_counter_) {
-          --crossfade_counter_;
-          float tail_sample = tail_[kCrossFadeSize - crossfade_counter_];
-          float gain = crossfade_counter_ * (1.0f / float(kCrossFadeSize));
-          sample += (tail_sample / 32768.0f - sample) * gain;
+      if (crossfade_counter_) {
+        // Fade from the samples recorded while the buffer was frozen to the
+        // incoming signal.
+        float faded[kCrossFadeSize];
+        int32_t n = std::min(size, crossfade_counter_);
+        for (int32_t i = 0; i < n; ++i) {
+          int32_t counter = crossfade_counter_ - 1 - i;
+          float tail_sample = tail_[kCrossFadeSize - counter];
+          float gain = counter * (1.0f / float(kCrossFadeSize));
+          faded[i] = in[i * stride];
+          faded[i] += (tail_sample / 32768.0f - faded[i]) * gain;
         }
-        Write(sample);
-        in += stride;
+        crossfade_counter_ -= n;
+        WriteIndexed(faded, n, 1, 32767.0f);
+        in += n * stride;
+        size -= n;
       }
+      WriteIndexed(in, size, stride, 32767.0f);
     }
   }
   
   inline void Write(const float* in, int32_t size, int32_t stride) {
-    if (resolution == RESOLUTION_16_BIT
-        && write_head_ >= kInterpolationTail && write_head_ < (size_ - size)) {
-      // Fast write routine for the most common case.
-      while (size--) {
-        s16_[write_head_] = stmlib::Clip16(
-            static_cast<int32_t>(*in * 32768.0f));
-        ++write_head_;
-        in += stride;
-      }
-    } else {
-      while (size--) {
-        Write(*in);
-        in += stride;
-      }
-    }
+    WriteIndexed(in, size, stride, 32768.0f);
   }
   
   template<InterpolationMethod method>
@@ -198,16 +249,21 @@ class AudioBuffer {
     if (integral >= size_) {
       integral -= size_;
     }
+    const int16_t* s16 = this->s16(integral);
+    const int8_t* s8 = this->s8(integral);
+    const float* f32 = this->f32(integral);
     
     float x0, scale;
-    if (resolution == RESOLUTION_16_BIT) {
-      x0 = s16_[integral];
+    if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      return f32[0];
+    } else if (resolution == RESOLUTION_16_BIT) {
+      x0 = s16[0];
       scale = 1.0f / 32768.0f;
     } else if (resolution == RESOLUTION_8_BIT_MU_LAW) {
-      x0 = MuLaw2Lin(s8_[integral]);
+      x0 = MuLaw2Lin(s8[0]);
       scale = 1.0f / 32768.0f;
     } else {
-      x0 = s8_[integral];
+      x0 = s8[0];
       scale = 1.0f / 128.0f;
     }
     return x0 * scale;
@@ -217,52 +273,193 @@ class AudioBuffer {
     if (integral >= size_) {
       integral -= size_;
     }
+    const int16_t* s16 = this->s16(integral);
+    const int8_t* s8 = this->s8(integral);
+    const float* f32 = this->f32(integral);
     
     // assert(integral >= 0 && integral < size_);
     
     float x0, x1, scale;
     float t = static_cast<float>(fractional) / 65536.0f;
-    if (resolution == RESOLUTION_16_BIT) {
-      x0 = s16_[integral];
-      x1 = s16_[integral + 1];
+    if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      x0 = f32[0];
+      x1 = f32[1];
+      scale = 1.0f;
+    } else if (resolution == RESOLUTION_16_BIT) {
+      x0 = s16[0];
+      x1 = s16[1];
       scale = 1.0f / 32768.0f;
     } else if (resolution == RESOLUTION_8_BIT_MU_LAW) {
-      x0 = MuLaw2Lin(s8_[integral]);
-      x1 = MuLaw2Lin(s8_[integral + 1]);
+      x0 = MuLaw2Lin(s8[0]);
+      x1 = MuLaw2Lin(s8[1]);
       scale = 1.0f / 32768.0f;
     } else {
-      x0 = s8_[integral];
-      x1 = s8_[integral + 1];
+      x0 = s8[0];
+      x1 = s8[1];
       scale = 1.0f / 128.0f;
     }
     return (x0 + (x1 - x0) * t) * scale;
   }
   
-  inline float ReadHermite(int32_t integral, uint16_t fractional) const {
-	integral = integral % size_;
+  inline float ReadHermite(
+      int32_t integral,
+      uint16_t fractional,
+      int32_t level) const {
+    return level
+        ? ReadPyramid(integral, fractional, level)
+        : ReadHermite(integral, fractional);
+  }
+  
+  // Reads from a decimated copy, at the same position as ReadHermite would
+  // in the recording. The interpolated sample is x0, one sample after
+  // integral.
+  inline float ReadPyramid(
+      int32_t integral,
+      uint16_t fractional,
+      int32_t level) const {
+    integral = integral % size_ + 1;
+    uint32_t phase = (static_cast<uint32_t>(
+        integral & ((1 << level) - 1)) << 16) | fractional;
+    float t = static_cast<float>(phase >> level) / 65536.0f;
+    integral = (integral >> level) - 1;
+    if (integral < 0) {
+      integral += level_size_[level];
+    } else if (integral >= level_size_[level]) {
+      integral -= level_size_[level];
+    }
+    
+    float xm1, x0, x1, x2, scale;
+    if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      const float* f32 = &level_f32_[level][integral];
+      xm1 = f32[0];
+      x0 = f32[1];
+      x1 = f32[2];
+      x2 = f32[3];
+      scale = 1.0f;
+    } else {
+      const int16_t* s16 = &level_s16_[level][integral];
+      xm1 = s16[0];
+      x0 = s16[1];
+      x1 = s16[2];
+      x2 = s16[3];
+      scale = 1.0f / 32768.0f;
+    }
+    const float c = (x1 - xm1) * 0.5f;
+    const float v = x0 - x1;
+    const float w = c + v;
+    const float a = w + v + (x2 - x0) * 0.5f;
+    const float b_neg = w + a;
+    return ((((a * t) - b_neg) * t + c) * t + x0) * scale;
+  }
+  
+  // Reads from a decimated copy with the given interpolation method, at the
+  // same position as Read<method>() would in the recording.
+  template<InterpolationMethod method>
+  inline float ReadPyramid(
+      int32_t integral,
+      uint16_t fractional,
+      int32_t level) const {
+    if (method == INTERPOLATION_HERMITE) {
+      return ReadPyramid(integral, fractional, level);
+    }
+    integral = integral % size_;
+    uint32_t phase = (static_cast<uint32_t>(
+        integral & ((1 << level) - 1)) << 16) | fractional;
+    float t = static_cast<float>(phase >> level) / 65536.0f;
+    integral >>= level;
     
+    float x0, x1, scale;
+    if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      const float* f32 = &level_f32_[level][integral];
+      x0 = f32[0];
+      x1 = f32[1];
+      scale = 1.0f;
+    } else {
+      const int16_t* s16 = &level_s16_[level][integral];
+      x0 = s16[0];
+      x1 = s16[1];
+      scale = 1.0f / 32768.0f;
+    }
+    if (method == INTERPOLATION_ZOH) {
+      return x0 * scale;
+    }
+    return (x0 + (x1 - x0) * t) * scale;
+  }
+  
+  inline float ReadHermite(int32_t integral, uint16_t fractional) const {
+    return ReadHermiteAt(integral % size_, fractional);
+  }
+  
+  // Reads a block of samples at the given 20.12 fixed point positions, which
+  // are expected to be close to each other. The position of the first one
+  // is wrapped around the buffer once, the others by comparison with it.
+  inline void ReadHermite(
+      const int32_t* position,
+      float* out,
+      int32_t size,
+      int32_t level) const {
+    if (level) {
+      while (size--) {
+        *out++ = ReadPyramid(*position >> 12, *position << 4, level);
+        ++position;
+      }
+      return;
+    }
+    int32_t integral = position[0] >> 12;
+    int32_t offset = integral - integral % size_;
+    while (size--) {
+      integral = (*position >> 12) - offset;
+      if (integral >= size_) {
+        integral -= size_;
+      } else if (integral < 0) {
+        integral += size_;
+      }
+      *out++ = ReadHermiteAt(integral, *position << 4);
+      ++position;
+    }
+  }
+  
+  inline int32_t size() const { return size_; }
+  inline int32_t head() const { return write_head_; }
+  inline const OnsetIndex& onsets() const { return onsets_; }
+  inline const ChunkIndex& chunks() const { return chunks_; }
+  inline int32_t segment_size() const { return split_; }
+  inline int32_t num_pyramid_levels() const { return num_levels_; }
+  
+ private:
+  inline float ReadHermiteAt(int32_t integral, uint16_t fractional) const {
+    const int16_t* s16 = this->s16(integral);
+    const int8_t* s8 = this->s8(integral);
+    const float* f32 = this->f32(integral);
+
     // assert(integral >= 0 && integral < size_);
     
     float xm1, x0, x1, x2, scale;
     float t = static_cast<float>(fractional) / 65536.0f;
     
-    if (resolution == RESOLUTION_16_BIT) {
-      xm1 = s16_[integral];
-      x0 = s16_[integral + 1];
-      x1 = s16_[integral + 2];
-      x2 = s16_[integral + 3];
+    if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      xm1 = f32[0];
+      x0 = f32[1];
+      x1 = f32[2];
+      x2 = f32[3];
+      scale = 1.0f;
+    } else if (resolution == RESOLUTION_16_BIT) {
+      xm1 = s16[0];
+      x0 = s16[1];
+      x1 = s16[2];
+      x2 = s16[3];
       scale = 1.0f / 32768.0f;
     } else if (resolution == RESOLUTION_8_BIT_MU_LAW) {
-      xm1 = MuLaw2Lin(s8_[integral]);
-      x0 = MuLaw2Lin(s8_[integral + 1]);
-      x1 = MuLaw2Lin(s8_[integral + 2]);
-      x2 = MuLaw2Lin(s8_[integral + 3]);
+      xm1 = MuLaw2Lin(s8[0]);
+      x0 = MuLaw2Lin(s8[1]);
+      x1 = MuLaw2Lin(s8[2]);
+      x2 = MuLaw2Lin(s8[3]);
       scale = 1.0f / 32768.0f;
     } else {
-      xm1 = s8_[integral];
-      x0 = s8_[integral + 1];
-      x1 = s8_[integral + 2];
-      x2 = s8_[integral + 3];
+      xm1 = s8[0];
+      x0 = s8[1];
+      x1 = s8[2];
+      x2 = s8[3];
       scale = 1.0f / 128.0f;
     }
     
@@ -275,23 +472,227 @@ class AudioBuffer {
     return ((((a * t) - b_neg) * t + c) * t + x0) * scale;
   }
   
-  inline int32_t size() const { return size_; }
-  inline int32_t head() const { return write_head_; }
+  inline const int16_t* s16(int32_t index) const {
+    return index < split_ ? &s16_[index] : &s16_extension_[index - split_];
+  }
+  
+  inline const int8_t* s8(int32_t index) const {
+    return index < split_ ? &s8_[index] : &s8_extension_[index - split_];
+  }
+  
+  inline const float* f32(int32_t index) const {
+    return index < split_ ? &f32_[index] : &f32_extension_[index - split_];
+  }
+  
+  inline int16_t* mutable_s16(int32_t index) {
+    return index < split_ ? &s16_[index] : &s16_extension_[index - split_];
+  }
+  
+  inline int8_t* mutable_s8(int32_t index) {
+    return index < split_ ? &s8_[index] : &s8_extension_[index - split_];
+  }
+  
+  inline float* mutable_f32(int32_t index) {
+    return index < split_ ? &f32_[index] : &f32_extension_[index - split_];
+  }
+  
+  // Updates the onset and chunk indices with the samples actually stored,
+  // and writes them.
+  inline void WriteIndexed(
+      const float* in,
+      int32_t size,
+      int32_t stride,
+      float scale) {
+    if (!size) {
+      return;
+    }
+    onsets_.Process(in, size, stride);
+    chunks_.Process(in, size, stride);
+    WriteBlock(in, size, stride, scale);
+  }
+  
+  // Writes a block at the write head, split in runs which do not cross a
+  // segment boundary. Each run is encoded in one go, and the samples that
+  // have to be mirrored in a tail are copied afterwards.
+  inline void WriteBlock(
+      const float* in,
+      int32_t size,
+      int32_t stride,
+      float scale) {
+    while (size) {
+      int32_t start = write_head_;
+      int32_t end = start + size;
+      int32_t segment_end = start < split_ ? split_ : size_;
+      if (end > segment_end) {
+        end = segment_end;
+      }
+      Encode(in, start, end - start, stride, scale);
+      // Tested once per run: without a pyramid, writing costs nothing more.
+      if (num_levels_) {
+        const float* sample = in;
+        for (int32_t i = start; i < end; ++i) {
+          Decimate(i, *sample);
+          sample += stride;
+        }
+      }
+      if (start < kInterpolationTail) {
+        CopyToTail(start, std::min(end, kInterpolationTail));
+      } else if (size_ != split_ && start >= split_ &&
+                 start < split_ + kInterpolationTail) {
+        CopyToTail(start, std::min(end, split_ + kInterpolationTail));
+      }
+      in += (end - start) * stride;
+      size -= end - start;
+      write_head_ = end >= size_ ? 0 : end;
+    }
+  }
+  
+  // Encodes a run of samples which does not cross a segment boundary.
+  inline void Encode(
+      const float* in,
+      int32_t start,
+      int32_t size,
+      int32_t stride,
+      float scale) {
+    if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      // No clipping: the buffer keeps the headroom of the signal path.
+      float* destination = mutable_f32(start);
+      while (size--) {
+        *destination++ = *in;
+        in += stride;
+      }
+    } else if (resolution == RESOLUTION_16_BIT) {
+      int16_t* destination = mutable_s16(start);
+      while (size--) {
+        *destination++ = stmlib::Clip16(static_cast<int32_t>(*in * scale));
+        in += stride;
+      }
+    } else if (resolution == RESOLUTION_8_BIT_DITHERED) {
+      // The quantization error has to be carried from sample to sample.
+      int8_t* destination = mutable_s8(start);
+      float error = quantization_error_;
+      while (size--) {
+        float sample = *in * 127.0f + error;
+        int32_t quantized = static_cast<int32_t>(sample);
+        if (quantized < -127) quantized = -127;
+        else if (quantized > 127) quantized = 127;
+        error = sample - *in;
+        *destination++ = quantized;
+        in += stride;
+      }
+      quantization_error_ = error;
+    } else if (resolution == RESOLUTION_8_BIT_MU_LAW) {
+      int8_t* destination = mutable_s8(start);
+      while (size--) {
+        *destination++ = Lin2MuLaw(
+            stmlib::Clip16(static_cast<int32_t>(*in * 32768.0f)));
+        in += stride;
+      }
+    } else {
+      int8_t* destination = mutable_s8(start);
+      while (size--) {
+        *destination++ = static_cast<int8_t>(
+            stmlib::Clip16(*in * 32768.0f) >> 8);
+        in += stride;
+      }
+    }
+  }
+  
+  // Feeds the half-band decimator of each level with a new sample, written
+  // at index in the level above it. Each decimated sample is aligned with
+  // every other sample of the level above.
+  inline void Decimate(int32_t index, float sample) {
+    for (int32_t level = 0; level < num_levels_; ++level) {
+      float* h = history_[level];
+      int32_t p = history_ptr_[level] = (history_ptr_[level] + 1) & 15;
+      h[p] = sample;
+      
+      int32_t center = index - kDecimatorDelay;
+      if (center < 0) {
+        center += level_size_[level];
+      }
+      if (center & 1) {
+        return;
+      }
+      sample = 0.5f * h[(p - 5) & 15] +
+          (150.0f / 512.0f) * (h[(p - 4) & 15] + h[(p - 6) & 15]) -
+          (25.0f / 512.0f) * (h[(p - 2) & 15] + h[(p - 8) & 15]) +
+          (3.0f / 512.0f) * (h[p] + h[(p - 10) & 15]);
+      index = center >> 1;
+      
+      if (resolution == RESOLUTION_32_BIT_FLOAT) {
+        float* destination = level_f32_[level + 1];
+        destination[index] = sample;
+        if (index < kInterpolationTail) {
+          destination[index + level_size_[level + 1]] = sample;
+        }
+      } else {
+        int16_t* destination = level_s16_[level + 1];
+        destination[index] = stmlib::Clip16(
+            static_cast<int32_t>(sample * 32768.0f));
+        if (index < kInterpolationTail) {
+          destination[index + level_size_[level + 1]] = destination[index];
+        }
+      }
+    }
+  }
+  
+  // Copies the samples in [start, end) to the tail of the segment logically
+  // preceding them. The range is either at the beginning of the buffer, or
+  // at the beginning of the second segment.
+  inline void CopyToTail(int32_t start, int32_t end) {
+    if (resolution == RESOLUTION_32_BIT_FLOAT) {
+      const float* source = f32(start);
+      float* destination = start < split_
+          ? &f32_extension_[size_ - split_ + start]
+          : &f32_[start];
+      std::copy(source, source + (end - start), destination);
+    } else if (resolution == RESOLUTION_16_BIT) {
+      const int16_t* source = s16(start);
+      int16_t* destination = start < split_
+          ? &s16_extension_[size_ - split_ + start]
+          : &s16_[start];
+      std::copy(source, source + (end - start), destination);
+    } else {
+      const int8_t* source = s8(start);
+      int8_t* destination = start < split_
+          ? &s8_extension_[size_ - split_ + start]
+          : &s8_[start];
+      std::copy(source, source + (end - start), destination);
+    }
+  }
   
- private:
   int16_t* s16_;
   int8_t* s8_;
+  float* f32_;
+  int16_t* s16_extension_;
+  int8_t* s8_extension_;
+  float* f32_extension_;
   
   float quantization_error_;
   
   int16_t tail_ptr_;
 
   int32_t size_;
+  int32_t split_;
   int32_t write_head_;
   
   int16_t* tail_;
   int32_t crossfade_counter_;
   
+  OnsetIndex onsets_;
+  ChunkIndex chunks_;
+  
+  // Latency of the 11-tap half-band decimation filter.
+  static const int32_t kDecimatorDelay = 5;
+  
+  int32_t num_levels_;
+  int32_t level_size_[kNumPyramidLevels + 1];
+  int16_t* level_s16_[kNumPyramidLevels + 1];
+  float* level_f32_[kNumPyramidLevels + 1];
+  float history_[kNumPyramidLevels][16];
+  int32_t history_ptr_[kNumPyramidLevels];
+  
   DISALLOW_COPY_AND_ASSIGN(AudioBuffer);
 };
 
@@ -0,0 +1,178 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Peak and RMS summary of each chunk of samples of a recording buffer.
+//
+// The summaries are computed on the samples written to the buffer, and are
+// only valid once a chunk has been completely written. Like the onset index,
+// the number of chunks is bounded, and their size grows with the size of the
+// buffer.
+
+#ifndef CLOUDS_DSP_CHUNK_INDEX_H_
+#define CLOUDS_DSP_CHUNK_INDEX_H_
+
+#include <algorithm>
+#include <cmath>
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+const int32_t kChunkIndexSize = 128;
+const int32_t kChunkMinShift = 8;
+const uint16_t kNoSummary = 0xffff;
+
+class ChunkIndex {
+ public:
+  ChunkIndex() { }
+  ~ChunkIndex() { }
+
+  void Init(int32_t size) {
+    size_ = size;
+    shift_ = kChunkMinShift;
+    while (((size - 1) >> shift_) >= kChunkIndexSize) {
+      ++shift_;
+    }
+    num_chunks_ = ((size - 1) >> shift_) + 1;
+    Resync(0);
+  }
+
+  void Resync(int32_t head) {
+    std::fill(&peak_[0], &peak_[kChunkIndexSize], kNoSummary);
+    std::fill(&rms_[0], &rms_[kChunkIndexSize], kNoSummary);
+    head_ = head;
+    chunk_ = head >> shift_;
+    // If recording resumes in the middle of a chunk, the samples counted
+    // will not cover the whole chunk and it won't be summarized.
+    count_ = 0;
+    peak_acc_ = 0.0f;
+    energy_acc_ = 0.0f;
+  }
+
+  // Analyzes a block of samples about to be written at the write head.
+  inline void Process(const float* in, int32_t size, int32_t stride) {
+    while (size) {
+      int32_t chunk_end = std::min((chunk_ + 1) << shift_, size_);
+      int32_t n = std::min(size, chunk_end - head_);
+      float peak = peak_acc_;
+      float energy = energy_acc_;
+      for (int32_t i = 0; i < n; ++i) {
+        float sample = *in;
+        float magnitude = std::fabs(sample);
+        if (magnitude > peak) {
+          peak = magnitude;
+        }
+        energy += sample * sample;
+        in += stride;
+      }
+      peak_acc_ = peak;
+      energy_acc_ = energy;
+      head_ += n;
+      count_ += n;
+      size -= n;
+
+      if (head_ == chunk_end) {
+        int32_t chunk_size = chunk_end - (chunk_ << shift_);
+        if (count_ == chunk_size) {
+          peak_[chunk_] = Quantize(peak);
+          rms_[chunk_] = Quantize(sqrtf(energy / chunk_size));
+        }
+        head_ = chunk_end >= size_ ? 0 : chunk_end;
+        chunk_ = head_ >> shift_;
+        count_ = 0;
+        peak_acc_ = 0.0f;
+        energy_acc_ = 0.0f;
+        // This chunk is about to be overwritten.
+        peak_[chunk_] = rms_[chunk_] = kNoSummary;
+      }
+    }
+  }
+
+  // Returns true if all the samples in [start, start + size) belong to
+  // chunks known to be silent, that is to say with no sample above one LSB
+  // of a 16-bit recording.
+  inline bool IsSilent(int32_t start, int32_t size) const {
+    while (start < 0) {
+      start += size_;
+    }
+    while (start >= size_) {
+      start -= size_;
+    }
+    int32_t chunk = start >> shift_;
+    int32_t last = start + size - 1;
+    while (last >= size_) {
+      last -= size_;
+    }
+    last >>= shift_;
+    for (int32_t i = 0; i < num_chunks_; ++i) {
+      if (peak_[chunk] != 0) {
+        return false;
+      }
+      if (chunk == last) {
+        return true;
+      }
+      chunk = chunk + 1 == num_chunks_ ? 0 : chunk + 1;
+    }
+    return true;
+  }
+
+  inline bool valid(int32_t chunk) const { return peak_[chunk] != kNoSummary; }
+  inline float peak(int32_t chunk) const { return Dequantize(peak_[chunk]); }
+  inline float rms(int32_t chunk) const { return Dequantize(rms_[chunk]); }
+
+  inline int32_t num_chunks() const { return num_chunks_; }
+  inline int32_t chunk_size() const { return 1 << shift_; }
+
+ private:
+  static inline uint16_t Quantize(float value) {
+    int32_t quantized = static_cast<int32_t>(value * 32767.0f);
+    return quantized > kNoSummary - 1 ? kNoSummary - 1 : quantized;
+  }
+
+  static inline float Dequantize(uint16_t value) {
+    return static_cast<float>(value) / 32767.0f;
+  }
+
+  int32_t size_;
+  int32_t shift_;
+  int32_t num_chunks_;
+
+  int32_t head_;
+  int32_t chunk_;
+  int32_t count_;
+  float peak_acc_;
+  float energy_acc_;
+
+  // Peak and RMS values of each chunk, scaled so that 32767 is full scale.
+  uint16_t peak_[kChunkIndexSize];
+  uint16_t rms_[kChunkIndexSize];
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkIndex);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_CHUNK_INDEX_H_
@@ -39,36 +39,129 @@ void Correlator::Init(uint32_t* source, uint32_t* destination) {
   destination_ = destination;
   offset_ = 0;
   best_match_ = 0;
+  period_ = 0;
+  search_periods_ = true;
   done_ = true;
 }
 
-void Correlator::EvaluateNextCandidate() {
-  if (done_) {
-    return;
-  }
+uint32_t Correlator::Correlate(const uint32_t* source, int32_t offset) const {
   uint32_t num_words = size_ >> 5;
-  uint32_t offset_words = candidate_ >> 5;
-  uint32_t offset_bits = candidate_ & 0x1f;
-  uint32_t* source = &source_[0];
-  uint32_t* destination = &destination_[offset_words];
+  uint32_t offset_words = offset >> 5;
+  uint32_t offset_bits = offset & 0x1f;
+  const uint32_t* destination = &destination_[offset_words];
   
   uint32_t xcorr = 0;
   for (uint32_t i = 0; i < num_words; ++i) {
     uint32_t source_bits = source[i];
     uint32_t destination_bits = 0;
     destination_bits |= destination[i] << offset_bits;
-    destination_bits |= destination[i + 1] >> (32 - offset_bits);
+    // A shift by 32 is undefined, and is a no-op on x86.
+    if (offset_bits) {
+      destination_bits |= destination[i + 1] >> (32 - offset_bits);
+    }
     uint32_t count = ~(source_bits ^ destination_bits);
     count = count - ((count >> 1) & 0x55555555);
     count = (count & 0x33333333) + ((count >> 2) & 0x33333333);
     count = (((count + (count >> 4)) & 0xf0f0f0f) * 0x1010101) >> 24;
     xcorr += count;
   }
+  return xcorr;
+}
+
+int32_t Correlator::NextRisingEdge(int32_t position, int32_t size) const {
+  while (position < size) {
+    int32_t i = position >> 5;
+    uint32_t word = destination_[i];
+    uint32_t previous_bit = i ? destination_[i - 1] & 1 : 1;
+    uint32_t rising = word & ~((word >> 1) | (previous_bit << 31));
+    rising &= 0xffffffff >> (position & 0x1f);
+    if (rising) {
+      return (i << 5) + __builtin_clz(rising);
+    }
+    position = (i + 1) << 5;
+  }
+  return -1;
+}
+
+int32_t Correlator::EstimatePeriod() const {
+  // Edges closer than kMinCorrelatorPeriod to the previous one are caused
+  // by noise around zero crossings, and are skipped.
+  const int32_t size = size_ * 2;
+  int32_t first = NextRisingEdge(0, size);
+  int32_t last = first;
+  int32_t num_intervals = 0;
+  while (first >= 0) {
+    int32_t edge = NextRisingEdge(last + kMinCorrelatorPeriod, size);
+    if (edge < 0) {
+      break;
+    }
+    last = edge;
+    ++num_intervals;
+  }
+  
+  // At least 4 periods are needed to trust the estimate.
+  if (num_intervals < 4) {
+    return 0;
+  }
+  int32_t period = (last - first) / num_intervals;
+  if (period * 4 > size_) {
+    return 0;
+  }
+  
+  // Most intervals must be within 1/8th of the average, otherwise the
+  // material is not periodic enough.
+  int32_t tolerance = period >> 3;
+  int32_t num_regular = 0;
+  for (int32_t edge = first; edge < last; ) {
+    int32_t next = NextRisingEdge(edge + kMinCorrelatorPeriod, size);
+    int32_t interval = next - edge;
+    if (interval >= period - tolerance && interval <= period + tolerance) {
+      ++num_regular;
+    }
+    edge = next;
+  }
+  if (num_regular * 4 < num_intervals * 3) {
+    return 0;
+  }
+  
+  // Edges can also be regularly spaced at a fraction of the period, when
+  // the waveform has several zero crossings per period. Check that the
+  // destination matches itself one period later.
+  uint32_t score = Correlate(destination_, period);
+  return score * 8 >= static_cast<uint32_t>(size_) * 7 ? period : 0;
+}
+
+void Correlator::EvaluateNextCandidate() {
+  if (done_) {
+    return;
+  }
+  if (period_ < 0) {
+    period_ = search_periods_ ? EstimatePeriod() : 0;
+    // Start with the whole first period.
+    last_candidate_ = period_ - 1;
+    peak_ = 0;
+    peak_score_ = 0;
+    return;
+  }
+  uint32_t xcorr = Correlate(source_, candidate_);
   if (xcorr > best_score_) {
     best_match_ = candidate_;
     best_score_ = xcorr;
   }
+  if (xcorr > peak_score_) {
+    peak_ = candidate_;
+    peak_score_ = xcorr;
+  }
   ++candidate_;
+  if (period_ && candidate_ > last_candidate_) {
+    // Move to the neighbourhood of the next peak, one period after the one
+    // just found, so that errors on the period do not accumulate.
+    int32_t next_peak = peak_ + period_;
+    int32_t radius = 1 + (period_ >> 4);
+    candidate_ = max(candidate_, next_peak - radius);
+    last_candidate_ = next_peak + radius;
+    peak_score_ = 0;
+  }
   done_ = candidate_ >= size_;
 }
 
@@ -82,6 +175,7 @@ void Correlator::StartSearch(
   best_match_ = 0;
   candidate_ = 0;
   size_ = size;
+  period_ = -1;
   done_ = false;
 }
 
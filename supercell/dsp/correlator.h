@@ -27,6 +27,12 @@
 // Search for stretch/shift splicing points by maximizing correlation.
 // Correlation is computed by XOR-ing the bit sign of samples - this allows
 // 32 samples to be matched in one single XOR operation.
+//
+// On tonal material, the correlation peaks are one pitch period apart. The
+// period is estimated from the spacing of the rising edges of the sign bits,
+// and once the best alignment within the first period has been found, only
+// the neighbourhoods of the following peaks are evaluated. Noisy material,
+// for which no period can be found, gets the full search.
 
 #ifndef CLOUDS_DSP_CORRELATOR_H_
 #define CLOUDS_DSP_CORRELATOR_H_
@@ -34,7 +40,11 @@
 #include "stmlib/stmlib.h"
 
 namespace clouds {
-  
+
+// Shortest period, in sign bits, for which the search is restricted. Below
+// this, there are so many peaks that the full search is as fast.
+const int32_t kMinCorrelatorPeriod = 16;
+
 class Correlator {
  public:
   Correlator() { }
@@ -64,7 +74,20 @@ class Correlator {
 
   inline bool done() { return done_; }
   
+  // Period found for the current search, in sign bits, or 0 when all
+  // candidates are evaluated.
+  inline int32_t period() const { return period_ < 0 ? 0 : period_; }
+  
+  inline void set_search_periods(bool search_periods) {
+    search_periods_ = search_periods;
+  }
+  
  private:
+  uint32_t Correlate(const uint32_t* source, int32_t offset) const;
+  int32_t NextRisingEdge(int32_t position, int32_t size) const;
+  int32_t EstimatePeriod() const;
+  
+
   uint32_t* source_;
   uint32_t* destination_;
   
@@ -78,6 +101,13 @@ class Correlator {
   
   int32_t trace_;
   
+  // -1 until estimated by the first call to EvaluateNextCandidate().
+  int32_t period_;
+  int32_t last_candidate_;
+  uint32_t peak_score_;
+  int32_t peak_;
+  bool search_periods_;
+  
   bool done_;
   
   DISALLOW_COPY_AND_ASSIGN(Correlator);
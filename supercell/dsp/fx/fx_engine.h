@@ -339,6 +339,43 @@ class FxEngine {
     }
   }
   
+  // Block processing, for effects in which each delay line is written once
+  // and read with interpolation. The i-th sample of a block is processed
+  // with write_ptr(i), the position Start() would have set for it, and the
+  // engine is moved forward by the block size with Advance().
+  inline int32_t write_ptr(int32_t i) const {
+    return (write_ptr_ - 1 - i) & MASK;
+  }
+  
+  inline void Advance(int32_t num_samples) {
+    write_ptr_ = (write_ptr_ - num_samples) & MASK;
+  }
+  
+  template<typename D>
+  inline void Write(int32_t write_ptr, float value) {
+    STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+    buffer_[(write_ptr + D::base) & MASK] = DataType<format>::Compress(value);
+  }
+  
+  template<typename D>
+  inline float InterpolateHermite(int32_t write_ptr, float offset) const {
+    STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+    MAKE_INTEGRAL_FRACTIONAL(offset);
+    const int32_t base = write_ptr + offset_integral + D::base;
+    float xm1 = DataType<format>::Decompress(buffer_[(base - 1) & MASK]);
+    float x0 = DataType<format>::Decompress(buffer_[(base + 0) & MASK]);
+    float x1 = DataType<format>::Decompress(buffer_[(base + 1) & MASK]);
+    float x2 = DataType<format>::Decompress(buffer_[(base + 2) & MASK]);
+
+    float c = (x1 - xm1) * 0.5f;
+    float v = x0 - x1;
+    float w = c + v;
+    float a = w + v + (x2 - x0) * 0.5f;
+    float b_neg = w + a;
+    float t = offset_fractional;
+    return (((a * t) - b_neg) * t + c) * t + x0;
+  }
+  
  private:
   enum {
     MASK = size - 1
@@ -0,0 +1,284 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Delay line engine running the same program on several independent instances
+// at once. The instances are laid out in lanes: each has its own memory and its
+// own parameters, but they share the write pointer, the delay line offsets and
+// the LFOs, so that every access is a contiguous load or store of num_lanes
+// values, which the compiler turns into SIMD code.
+
+#ifndef CLOUDS_DSP_FX_LANE_FX_ENGINE_H_
+#define CLOUDS_DSP_FX_LANE_FX_ENGINE_H_
+
+#include <algorithm>
+
+#include "stmlib/stmlib.h"
+
+#include "stmlib/dsp/dsp.h"
+#include "stmlib/dsp/cosine_oscillator.h"
+
+#include "supercell/dsp/fx/fx_engine.h"
+
+namespace clouds {
+
+template<
+    size_t size,
+    size_t num_lanes,
+    Format format = FORMAT_12_BIT>
+class LaneFxEngine {
+ public:
+  typedef typename DataType<format>::T T;
+  typedef float Lanes[num_lanes];
+
+  LaneFxEngine() { }
+  ~LaneFxEngine() { }
+
+  // The buffer holds size * num_lanes values.
+  void Init(T* buffer) {
+    buffer_ = buffer;
+    Clear();
+  }
+  
+  void Clear() {
+    std::fill(&buffer_[0], &buffer_[size * num_lanes], 0);
+    write_ptr_ = 0;
+  }
+
+  struct Empty { };
+  
+  template<int32_t l, typename T = Empty>
+  struct Reserve {
+    typedef T Tail;
+    enum {
+      length = l
+    };
+  };
+  
+  template<typename Memory, int32_t index>
+  struct DelayLine {
+    enum {
+      length = DelayLine<typename Memory::Tail, index - 1>::length,
+      base = DelayLine<Memory, index - 1>::base + DelayLine<Memory, index - 1>::length + 1
+    };
+  };
+
+  template<typename Memory>
+  struct DelayLine<Memory, 0> {
+    enum {
+      length = Memory::length,
+      base = 0
+    };
+  };
+
+  // Scales are either shared by all lanes, or given for each lane.
+  static inline float lane(float value, size_t i) {
+    return value;
+  }
+  
+  static inline float lane(const Lanes& value, size_t i) {
+    return value[i];
+  }
+
+  class Context {
+   friend class LaneFxEngine;
+   public:
+    Context() { }
+    ~Context() { }
+    
+    inline void Load(const Lanes& value) {
+      for (size_t i = 0; i < num_lanes; ++i) {
+        accumulator_[i] = value[i];
+      }
+    }
+
+    template<typename S>
+    inline void Read(const Lanes& value, const S& scale) {
+      for (size_t i = 0; i < num_lanes; ++i) {
+        accumulator_[i] += value[i] * lane(scale, i);
+      }
+    }
+
+    inline void Write(Lanes& value) {
+      for (size_t i = 0; i < num_lanes; ++i) {
+        value[i] = accumulator_[i];
+      }
+    }
+
+    inline void Write(Lanes& value, float scale) {
+      for (size_t i = 0; i < num_lanes; ++i) {
+        value[i] = accumulator_[i];
+        accumulator_[i] *= scale;
+      }
+    }
+    
+    template<typename Memory, int32_t index, typename S>
+    inline void Write(
+        DelayLine<Memory, index>& d, int32_t offset, const S& scale) {
+      typedef DelayLine<Memory, index> D;
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      T* w = &buffer_[
+          ((write_ptr_ + D::base + (offset == -1 ? D::length - 1 : offset))
+              & MASK) * num_lanes];
+      for (size_t i = 0; i < num_lanes; ++i) {
+        w[i] = DataType<format>::Compress(accumulator_[i]);
+      }
+      for (size_t i = 0; i < num_lanes; ++i) {
+        accumulator_[i] *= lane(scale, i);
+      }
+    }
+    
+    template<typename Memory, int32_t index, typename S>
+    inline void Write(DelayLine<Memory, index>& d, const S& scale) {
+      Write(d, 0, scale);
+    }
+
+    template<typename Memory, int32_t index, typename S>
+    inline void WriteAllPass(
+        DelayLine<Memory, index>& d, int32_t offset, const S& scale) {
+      Write(d, offset, scale);
+      for (size_t i = 0; i < num_lanes; ++i) {
+        accumulator_[i] += previous_read_[i];
+      }
+    }
+    
+    template<typename Memory, int32_t index, typename S>
+    inline void WriteAllPass(DelayLine<Memory, index>& d, const S& scale) {
+      WriteAllPass(d, 0, scale);
+    }
+    
+    template<typename Memory, int32_t index, typename S>
+    inline void Read(
+        DelayLine<Memory, index>& d, int32_t offset, const S& scale) {
+      typedef DelayLine<Memory, index> D;
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      const T* r = &buffer_[
+          ((write_ptr_ + D::base + (offset == -1 ? D::length - 1 : offset))
+              & MASK) * num_lanes];
+      for (size_t i = 0; i < num_lanes; ++i) {
+        float r_f = DataType<format>::Decompress(r[i]);
+        previous_read_[i] = r_f;
+        accumulator_[i] += r_f * lane(scale, i);
+      }
+    }
+    
+    template<typename Memory, int32_t index, typename S>
+    inline void Read(DelayLine<Memory, index>& d, const S& scale) {
+      Read(d, 0, scale);
+    }
+
+    template<typename S>
+    inline void Lp(Lanes& state, const S& coefficient) {
+      for (size_t i = 0; i < num_lanes; ++i) {
+        state[i] += lane(coefficient, i) * (accumulator_[i] - state[i]);
+        accumulator_[i] = state[i];
+      }
+    }
+
+    template<typename S>
+    inline void Hp(Lanes& state, const S& coefficient) {
+      for (size_t i = 0; i < num_lanes; ++i) {
+        state[i] += lane(coefficient, i) * (accumulator_[i] - state[i]);
+        accumulator_[i] -= state[i];
+      }
+    }
+
+    template<typename Memory, int32_t index, typename S>
+    inline void Interpolate(
+        DelayLine<Memory, index>& d, float offset, const S& scale) {
+      typedef DelayLine<Memory, index> D;
+      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      MAKE_INTEGRAL_FRACTIONAL(offset);
+      const T* a = &buffer_[
+          ((write_ptr_ + offset_integral + D::base) & MASK) * num_lanes];
+      const T* b = &buffer_[
+          ((write_ptr_ + offset_integral + D::base + 1) & MASK) * num_lanes];
+      for (size_t i = 0; i < num_lanes; ++i) {
+        float a_f = DataType<format>::Decompress(a[i]);
+        float b_f = DataType<format>::Decompress(b[i]);
+        float x = a_f + (b_f - a_f) * offset_fractional;
+        previous_read_[i] = x;
+        accumulator_[i] += x * lane(scale, i);
+      }
+    }
+
+    template<typename Memory, int32_t index, typename S>
+    inline void Interpolate(
+        DelayLine<Memory, index>& d,
+        float offset,
+        LFOIndex lfo,
+        float amplitude,
+        const S& scale) {
+      Interpolate(d, offset + amplitude * lfo_value_[lfo], scale);
+    }
+    
+   private:
+    Lanes accumulator_;
+    Lanes previous_read_;
+    float lfo_value_[2];
+    T* buffer_;
+    int32_t write_ptr_;
+
+    DISALLOW_COPY_AND_ASSIGN(Context);
+  };
+  
+  inline void SetLFOFrequency(LFOIndex index, float frequency) {
+    lfo_[index].template Init<stmlib::COSINE_OSCILLATOR_APPROXIMATE>(
+        frequency * 32.0f);
+  }
+  
+  inline void Start(Context* c) {
+    --write_ptr_;
+    if (write_ptr_ < 0) {
+      write_ptr_ += size;
+    }
+    std::fill(&c->accumulator_[0], &c->accumulator_[num_lanes], 0.0f);
+    std::fill(&c->previous_read_[0], &c->previous_read_[num_lanes], 0.0f);
+    c->buffer_ = buffer_;
+    c->write_ptr_ = write_ptr_;
+    if ((write_ptr_ & 31) == 0) {
+      c->lfo_value_[0] = lfo_[0].Next();
+      c->lfo_value_[1] = lfo_[1].Next();
+    } else {
+      c->lfo_value_[0] = lfo_[0].value();
+      c->lfo_value_[1] = lfo_[1].value();
+    }
+  }
+  
+ private:
+  enum {
+    MASK = size - 1
+  };
+  
+  int32_t write_ptr_;
+  T* buffer_;
+  stmlib::CosineOscillator lfo_[2];
+  
+  DISALLOW_COPY_AND_ASSIGN(LaneFxEngine);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_FX_LANE_FX_ENGINE_H_
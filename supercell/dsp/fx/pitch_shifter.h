@@ -30,6 +30,9 @@
 #define CLOUDS_DSP_FX_PITCH_SHIFTER_H_
 
 #include "stmlib/stmlib.h"
+
+#include <algorithm>
+
 #include "stmlib/dsp/dsp.h"
 
 #include "supercell/resources.h"
@@ -54,10 +57,47 @@ class PitchShifter {
     engine_.Clear();
   }
 
+  // Block version of the per-sample Process() below. The read positions and
+  // crossfade gains are computed for the whole block first, then both
+  // channels are written to and read from their delay lines in one pass.
+  // The channels are kept in step: with a window of 2047 samples, the taps
+  // of the right delay line reach into the samples of the left one.
   inline void Process(FloatFrame* input_output, size_t size) {
-    while (size--) {
-      Process(input_output);
-      ++input_output;
+    typedef E::Reserve<2047, E::Reserve<2047> > Memory;
+    typedef E::DelayLine<Memory, 0> Left;
+    typedef E::DelayLine<Memory, 1> Right;
+    
+    while (size) {
+      size_t block_size = std::min(size, kMaxBlockSize);
+      float phase[kMaxBlockSize];
+      float half[kMaxBlockSize];
+      float tri[kMaxBlockSize];
+      for (size_t i = 0; i < block_size; ++i) {
+        phase_ += (1.0f - ratio_) / size_;
+        if (phase_ >= 1.0f) {
+          phase_ -= 1.0f;
+        }
+        if (phase_ <= 0.0f) {
+          phase_ += 1.0f;
+        }
+        float t = 2.0f * (phase_ >= 0.5f ? 1.0f - phase_ : phase_);
+        tri[i] = stmlib::Interpolate(lut_window, t, LUT_WINDOW_SIZE-1);
+        phase[i] = phase_ * size_;
+        half[i] = phase[i] + size_ * 0.5f;
+        if (half[i] >= size_) {
+          half[i] -= size_;
+        }
+      }
+      for (size_t i = 0; i < block_size; ++i) {
+        int32_t write_ptr = engine_.write_ptr(i);
+        ProcessSample<Left>(
+            write_ptr, phase[i], half[i], tri[i], &input_output[i].l);
+        ProcessSample<Right>(
+            write_ptr, phase[i], half[i], tri[i], &input_output[i].r);
+      }
+      engine_.Advance(block_size);
+      input_output += block_size;
+      size -= block_size;
     }
   }
   
@@ -118,6 +158,21 @@ class PitchShifter {
   
  private:
   typedef FxEngine<4096, FORMAT_16_BIT> E;
+  
+  template<typename D>
+  inline void ProcessSample(
+      int32_t write_ptr,
+      float phase,
+      float half,
+      float tri,
+      float* sample) {
+    float in = *sample;
+    engine_.Write<D>(write_ptr, in);
+    float wet = engine_.InterpolateHermite<D>(write_ptr, phase) * tri;
+    wet += engine_.InterpolateHermite<D>(write_ptr, half) * (1.0f - tri);
+    *sample = in + (wet - in) * dry_wet_;
+  }
+
   E engine_;
   float phase_;
   float ratio_;
@@ -0,0 +1,212 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Several instances of the reverb, processed together in the lanes of a
+// LaneFxEngine. Every instance has its own input, memory and parameters, and
+// gives the same output as a Reverb fed with the same signal. The delay memory
+// is made of 16-bit words, so the bank has 8 lanes to fill a 128-bit register.
+// There is no 4 lanes variant: the 12-bit conversions of half a register do
+// not vectorize, and it would be no faster than separate reverbs.
+
+#ifndef CLOUDS_DSP_FX_REVERB_BANK_H_
+#define CLOUDS_DSP_FX_REVERB_BANK_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "supercell/dsp/frame.h"
+#include "supercell/dsp/fx/lane_fx_engine.h"
+
+namespace clouds {
+
+class ReverbBank {
+ public:
+  enum {
+    kMemorySize = 16384,
+    kNumLanes = 8
+  };
+
+  ReverbBank() { }
+  ~ReverbBank() { }
+
+  // The buffer holds kMemorySize * kNumLanes samples.
+  void Init(uint16_t* buffer) {
+    engine_.Init(buffer);
+    engine_.SetLFOFrequency(LFO_1, 0.5f / 32000.0f);
+    engine_.SetLFOFrequency(LFO_2, 0.3f / 32000.0f);
+    for (size_t i = 0; i < kNumLanes; ++i) {
+      amount_[i] = 0.0f;
+      input_gain_[i] = 0.0f;
+      reverb_time_[i] = 0.0f;
+      lp_[i] = 0.7f;
+      diffusion_[i] = 0.625f;
+      lp_decay_1_[i] = 0.0f;
+      lp_decay_2_[i] = 0.0f;
+    }
+  }
+
+  // in_out[i] is the block of the i-th instance.
+  void Process(FloatFrame** in_out, size_t size) {
+    // Same program as Reverb::Process.
+    typedef E::Reserve<113,
+      E::Reserve<162,
+      E::Reserve<241,
+      E::Reserve<399,
+      E::Reserve<1653,
+      E::Reserve<2038,
+      E::Reserve<3411,
+      E::Reserve<1913,
+      E::Reserve<1663,
+      E::Reserve<4782> > > > > > > > > > Memory;
+    E::DelayLine<Memory, 0> ap1;
+    E::DelayLine<Memory, 1> ap2;
+    E::DelayLine<Memory, 2> ap3;
+    E::DelayLine<Memory, 3> ap4;
+    E::DelayLine<Memory, 4> dap1a;
+    E::DelayLine<Memory, 5> dap1b;
+    E::DelayLine<Memory, 6> del1;
+    E::DelayLine<Memory, 7> dap2a;
+    E::DelayLine<Memory, 8> dap2b;
+    E::DelayLine<Memory, 9> del2;
+    E::Context c;
+
+    Lanes kap, minus_kap;
+    for (size_t i = 0; i < kNumLanes; ++i) {
+      kap[i] = diffusion_[i];
+      minus_kap[i] = -diffusion_[i];
+    }
+    const Lanes& klp = lp_;
+    const Lanes& krt = reverb_time_;
+    const Lanes& amount = amount_;
+    const Lanes& gain = input_gain_;
+
+    Lanes lp_1, lp_2;
+    std::copy(&lp_decay_1_[0], &lp_decay_1_[kNumLanes], &lp_1[0]);
+    std::copy(&lp_decay_2_[0], &lp_decay_2_[kNumLanes], &lp_2[0]);
+
+    for (size_t n = 0; n < size; ++n) {
+      Lanes in;
+      Lanes wet;
+      Lanes apout;
+      for (size_t i = 0; i < kNumLanes; ++i) {
+        in[i] = in_out[i][n].l + in_out[i][n].r;
+      }
+      engine_.Start(&c);
+
+      // Smear AP1 inside the loop.
+      c.Interpolate(ap1, 10.0f, LFO_1, 60.0f, 1.0f);
+      c.Write(ap1, 100, 0.0f);
+
+      c.Read(in, gain);
+
+      // Diffuse through 4 allpasses.
+      c.Read(ap1 TAIL, kap);
+      c.WriteAllPass(ap1, minus_kap);
+      c.Read(ap2 TAIL, kap);
+      c.WriteAllPass(ap2, minus_kap);
+      c.Read(ap3 TAIL, kap);
+      c.WriteAllPass(ap3, minus_kap);
+      c.Read(ap4 TAIL, kap);
+      c.WriteAllPass(ap4, minus_kap);
+      c.Write(apout);
+
+      // Main reverb loop.
+      c.Load(apout);
+      c.Interpolate(del2, 4680.0f, LFO_2, 100.0f, krt);
+      c.Lp(lp_1, klp);
+      c.Read(dap1a TAIL, minus_kap);
+      c.WriteAllPass(dap1a, kap);
+      c.Read(dap1b TAIL, kap);
+      c.WriteAllPass(dap1b, minus_kap);
+      c.Write(del1, 2.0f);
+      c.Write(wet, 0.0f);
+
+      for (size_t i = 0; i < kNumLanes; ++i) {
+        FloatFrame* frame = &in_out[i][n];
+        frame->l += (wet[i] - frame->l) * amount[i];
+      }
+
+      c.Load(apout);
+      c.Read(del1 TAIL, krt);
+      c.Lp(lp_2, klp);
+      c.Read(dap2a TAIL, kap);
+      c.WriteAllPass(dap2a, minus_kap);
+      c.Read(dap2b TAIL, minus_kap);
+      c.WriteAllPass(dap2b, kap);
+      c.Write(del2, 2.0f);
+      c.Write(wet, 0.0f);
+
+      for (size_t i = 0; i < kNumLanes; ++i) {
+        FloatFrame* frame = &in_out[i][n];
+        frame->r += (wet[i] - frame->r) * amount[i];
+      }
+    }
+
+    std::copy(&lp_1[0], &lp_1[kNumLanes], &lp_decay_1_[0]);
+    std::copy(&lp_2[0], &lp_2[kNumLanes], &lp_decay_2_[0]);
+  }
+
+  inline void set_amount(size_t lane, float amount) {
+    amount_[lane] = amount;
+  }
+
+  inline void set_input_gain(size_t lane, float input_gain) {
+    input_gain_[lane] = input_gain;
+  }
+
+  inline void set_time(size_t lane, float reverb_time) {
+    reverb_time_[lane] = reverb_time;
+  }
+
+  inline void set_diffusion(size_t lane, float diffusion) {
+    diffusion_[lane] = diffusion;
+  }
+
+  inline void set_lp(size_t lane, float lp) {
+    lp_[lane] = lp;
+  }
+
+ private:
+  typedef LaneFxEngine<kMemorySize, kNumLanes, FORMAT_12_BIT> E;
+  typedef E::Lanes Lanes;
+  E engine_;
+
+  Lanes amount_;
+  Lanes input_gain_;
+  Lanes reverb_time_;
+  Lanes diffusion_;
+  Lanes lp_;
+
+  Lanes lp_decay_1_;
+  Lanes lp_decay_2_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReverbBank);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_FX_REVERB_BANK_H_
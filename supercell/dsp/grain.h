@@ -148,6 +148,36 @@ class Grain {
     // Pre-render the envelope in one pass.
     RenderEnvelope(envelope, size);
 
+    // The level is picked once per block, so that the loop reading the
+    // recording does not have to test for the pyramid on every sample.
+    const int32_t level = buffer[0].pyramid_level(phase_increment_);
+    if (level) {
+      Render<num_channels, quality, true>(
+          buffer, destination, envelope, size, level);
+    } else {
+      Render<num_channels, quality, false>(
+          buffer, destination, envelope, size, 0);
+    }
+  }
+  
+  inline bool active() { return active_; }
+  
+  inline GrainQuality recommended_quality() const {
+    return recommended_quality_;
+  }
+
+ private:
+  template<
+      int32_t num_channels,
+      GrainQuality quality,
+      bool pyramid,
+      Resolution resolution>
+  inline void Render(
+      const AudioBuffer<resolution>* buffer,
+      float* destination,
+      const float* envelope,
+      size_t size,
+      int32_t level) {
     const int32_t phase_increment = phase_increment_;
     const int32_t first_sample = first_sample_;
     const float gain_l = gain_l_;
@@ -162,14 +192,20 @@ class Grain {
         break;
       }
 
-      float l = buffer[0].template Read<InterpolationMethod(quality)>(
-          sample_index, phase & 65535) * gain;
+      float l = (pyramid
+          ? buffer[0].template ReadPyramid<InterpolationMethod(quality)>(
+              sample_index, phase & 65535, level)
+          : buffer[0].template Read<InterpolationMethod(quality)>(
+              sample_index, phase & 65535)) * gain;
       if (num_channels == 1) {
         *destination++ += l * gain_l;
         *destination++ += l * gain_r;
       } else if (num_channels == 2) {
-        float r = buffer[1].template Read<InterpolationMethod(quality)>(
-            sample_index, phase & 65535) * gain;
+        float r = (pyramid
+            ? buffer[1].template ReadPyramid<InterpolationMethod(quality)>(
+                sample_index, phase & 65535, level)
+            : buffer[1].template Read<InterpolationMethod(quality)>(
+                sample_index, phase & 65535)) * gain;
         *destination++ += l * gain_l + r * (1.0f - gain_r);
         *destination++ += r * gain_r + l * (1.0f - gain_l);
       }
@@ -178,13 +214,6 @@ class Grain {
     phase_ = phase;
   }
   
-  inline bool active() { return active_; }
-  
-  inline GrainQuality recommended_quality() const {
-    return recommended_quality_;
-  }
-
- private:
   int32_t first_sample_;
   int32_t phase_;
   int32_t phase_increment_;
@@ -28,6 +28,7 @@
 
 #include "supercell/dsp/granular_processor.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "supercell/drivers/debug_pin.h"
@@ -49,13 +50,31 @@ void GranularProcessor::Init(
   buffer_[1] = small_buffer;
   buffer_size_[0] = large_buffer_size;
   buffer_size_[1] = small_buffer_size;
+  pyramid_buffer_ = NULL;
+  pyramid_buffer_size_ = 0;
+  extension_ = NULL;
+  extension_size_ = 0;
+  recording_source_ = NULL;
+  kernels_ = &GetKernels(BestKernelSet());
+#ifdef GRAIN_THREADS
+  worker_pool_ = NULL;
+#endif  // GRAIN_THREADS
 
   num_channels_ = 2;
   low_fidelity_ = false;
   bypass_ = false;
+  silence_ = false;
 
   src_down_.Init();
   src_up_.Init();
+  iir_src_down_.Init();
+  iir_src_up_.Init();
+  for (int32_t i = 0; i < 4; ++i) {
+    resampler_[i] = RESAMPLER_FIR;
+  }
+  prepare_schedule_ = PREPARE_SCHEDULE_SLICE;
+  prepare_budget_ = 1.0f;
+  prepare_credit_ = 0.0f;
 
   phase_vocoder_.Init();
 
@@ -67,8 +86,16 @@ void GranularProcessor::Init(
   mute_out_ = false;
   mute_in_fade_ = 0.0f;
   mute_out_fade_ = 0.0f;
+  freeze_lp_ = 0.0f;
   dry_wet_ = 0.0f;
+  dry_wet_increment_ = 0.0f;
+  dry_wet_ramp_ = 0;
+  control_samples_ = 0;
+  feedback_ = 0.0f;
+  fb_gain_ = 0.0f;
   reverb_dry_signal_ = true;
+  parameters_.snap_to_onsets = false;
+  parameters_.skip_silent_slices = false;
 }
 
 void GranularProcessor::ResetFilters() {
@@ -85,7 +112,10 @@ void GranularProcessor::ProcessGranular(
     size_t size) {
   // At the exception of the spectral mode, all modes require the incoming
   // audio signal to be written to the recording buffer.
-  if (playback_mode_ != PLAYBACK_MODE_SPECTRAL &&
+  // When playing from the recording of another processor, there is nothing
+  // to record.
+  if (!recording_source_ &&
+      playback_mode_ != PLAYBACK_MODE_SPECTRAL &&
       playback_mode_ != PLAYBACK_MODE_SPECTRAL_CLOUD &&
       playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
     const float* input_samples = &input[0].l;
@@ -123,26 +153,32 @@ void GranularProcessor::ProcessGranular(
       parameters_.granular.window_shape = parameters_.texture < 0.75f
           ? parameters_.texture * 1.333f : 1.0f;
 
+      if (update_controls_) {
+        player_.UpdateControls(parameters_);
+      }
       if (resolution() == 8) {
-        player_.Play(buffer_8_, parameters_, &output[0].l, size);
+        player_.Play(buffer_8(), parameters_, &output[0].l, size);
       } else {
-        player_.Play(buffer_16_, parameters_, &output[0].l, size);
+        player_.Play(buffer_16(), parameters_, &output[0].l, size);
       }
       break;
 
     case PLAYBACK_MODE_STRETCH:
+      if (update_controls_) {
+        ws_player_.UpdateControls(parameters_);
+      }
       if (resolution() == 8) {
-        ws_player_.Play(buffer_8_, parameters_, &output[0].l, size);
+        ws_player_.Play(buffer_8(), parameters_, &output[0].l, size);
       } else {
-        ws_player_.Play(buffer_16_, parameters_, &output[0].l, size);
+        ws_player_.Play(buffer_16(), parameters_, &output[0].l, size);
       }
       break;
 
     case PLAYBACK_MODE_LOOPING_DELAY:
       if (resolution() == 8) {
-        looper_.Play(buffer_8_, parameters_, &output[0].l, size);
+        looper_.Play(buffer_8(), parameters_, &output[0].l, size);
       } else {
-        looper_.Play(buffer_16_, parameters_, &output[0].l, size);
+        looper_.Play(buffer_16(), parameters_, &output[0].l, size);
       }
       break;
 
@@ -195,49 +231,54 @@ void GranularProcessor::ProcessGranular(
           0.0f // gate;
         };
 
+        if (update_controls_) {
+          ws_player_.UpdateControls(p);
+        }
         if (resolution() == 8) {
-          ws_player_.Play(buffer_8_, p, &output[0].l, size);
+          ws_player_.Play(buffer_8(), p, &output[0].l, size);
         } else {
-          ws_player_.Play(buffer_16_, p, &output[0].l, size);
+          ws_player_.Play(buffer_16(), p, &output[0].l, size);
         }
 
         // Settings of the reverb
-        oliverb_.set_diffusion(0.3f + 0.5f * parameters_.stereo_spread);
-        oliverb_.set_size(0.05f + 0.94f * parameters_.size);
-        oliverb_.set_mod_rate(parameters_.feedback);
-        oliverb_.set_mod_amount(parameters_.reverb * 300.0f);
-        oliverb_.set_ratio(SemitonesToRatio(parameters_.pitch));
-
-        float x = parameters_.pitch;
-        const float limit = 0.7f;
-        const float slew = 0.4f;
-
-        float wet =
-          x < -limit ? 1.0f :
-          x < -limit + slew ? 1.0f - (x + limit) / slew:
-          x < limit - slew ? 0.0f :
-          x < limit ? 1.0f + (x - limit) / slew:
-          1.0f;
-        oliverb_.set_pitch_shift_amount(wet);
-
-        if (parameters_.freeze) {
-          oliverb_.set_input_gain(0.0f);
-          oliverb_.set_decay(1.0f);
-          oliverb_.set_lp(1.0f);
-          oliverb_.set_hp(0.0f);
-        } else {
-          oliverb_.set_decay(parameters_.density * 1.3f
-                           + 0.15f * abs(parameters_.pitch) / 24.0f);
-          oliverb_.set_input_gain(0.5f);
-          float lp = parameters_.texture < 0.5f ?
-            parameters_.texture * 2.0f : 1.0f;
-          float hp = parameters_.texture > 0.5f ?
-            (parameters_.texture - 0.5f) * 2.0f : 0.0f;
-          oliverb_.set_lp(0.03f + 0.9f * lp);
-          oliverb_.set_hp(0.01f + 0.2f * hp); // the small offset
-                                                  // gets rid of
-                                                  // feedback of large
-                                                  // DC offset.
+        if (update_controls_) {
+          oliverb_.set_diffusion(0.3f + 0.5f * parameters_.stereo_spread);
+          oliverb_.set_size(0.05f + 0.94f * parameters_.size);
+          oliverb_.set_mod_rate(parameters_.feedback);
+          oliverb_.set_mod_amount(parameters_.reverb * 300.0f);
+          oliverb_.set_ratio(SemitonesToRatio(parameters_.pitch));
+
+          float x = parameters_.pitch;
+          const float limit = 0.7f;
+          const float slew = 0.4f;
+
+          float wet =
+            x < -limit ? 1.0f :
+            x < -limit + slew ? 1.0f - (x + limit) / slew:
+            x < limit - slew ? 0.0f :
+            x < limit ? 1.0f + (x - limit) / slew:
+            1.0f;
+          oliverb_.set_pitch_shift_amount(wet);
+
+          if (parameters_.freeze) {
+            oliverb_.set_input_gain(0.0f);
+            oliverb_.set_decay(1.0f);
+            oliverb_.set_lp(1.0f);
+            oliverb_.set_hp(0.0f);
+          } else {
+            oliverb_.set_decay(parameters_.density * 1.3f
+                             + 0.15f * abs(parameters_.pitch) / 24.0f);
+            oliverb_.set_input_gain(0.5f);
+            float lp = parameters_.texture < 0.5f ?
+              parameters_.texture * 2.0f : 1.0f;
+            float hp = parameters_.texture > 0.5f ?
+              (parameters_.texture - 0.5f) * 2.0f : 0.0f;
+            oliverb_.set_lp(0.03f + 0.9f * lp);
+            oliverb_.set_hp(0.01f + 0.2f * hp); // the small offset
+                                                    // gets rid of
+                                                    // feedback of large
+                                                    // DC offset.
+          }
         }
         oliverb_.Process(output, size);
       }
@@ -247,9 +288,10 @@ void GranularProcessor::ProcessGranular(
     {
       copy(&input[0], &input[size], &output[0]);
 
+      resonestor_.set_freeze(parameters_.freeze);
+      resonestor_.set_trigger(parameters_.trigger);
       resonestor_.set_pitch(parameters_.pitch);
       resonestor_.set_chord(parameters_.size);
-      resonestor_.set_trigger(parameters_.trigger);
       resonestor_.set_burst_damp(parameters_.position);
       resonestor_.set_burst_comb((1.0f - parameters_.position));
       resonestor_.set_burst_duration((1.0f - parameters_.position));
@@ -258,7 +300,6 @@ void GranularProcessor::ProcessGranular(
         (parameters_.stereo_spread - 0.5f) * 2.0f);
       resonestor_.set_separation(parameters_.stereo_spread > 0.5f ? 0.0f :
                                 (0.5f - parameters_.stereo_spread) * 2.0f);
-      resonestor_.set_freeze(parameters_.freeze);
       resonestor_.set_harmonicity(1.0f - (parameters_.feedback * 0.5f));
       resonestor_.set_distortion(parameters_.dry_wet);
 
@@ -288,9 +329,9 @@ void GranularProcessor::ProcessGranular(
 
   case PLAYBACK_MODE_KAMMERL:
     if (resolution() == 8) {
-      kammerl_.Play(buffer_8_, parameters_, &output[0].l, size);
+      kammerl_.Play(buffer_8(), parameters_, &output[0].l, size);
     } else {
-      kammerl_.Play(buffer_16_, parameters_, &output[0].l, size);
+      kammerl_.Play(buffer_16(), parameters_, &output[0].l, size);
     }
     break;
 
@@ -299,53 +340,47 @@ void GranularProcessor::ProcessGranular(
   }
 }
 
-void GranularProcessor::WarmDistortion(float* in, float parameter) {
-	if (parameter < 0.1) {
-		return;
-	}
-	static const float kMaxDistf = 2.0f;
-	const float fac = kMaxDistf * parameter;
-	const float amp = 1.0f - parameter * 0.45f;
-
-	float smp = *in;
-	smp = (1.0f + fac) * smp - fac * smp * smp * smp;
-
-	float sign = 1.0f;
-	if (smp < 0) {
-		sign = -1.0;
-	}
-	float tanh_loopup =  std::max(0.0f, std::min(1.0f, (smp / 2.0f) * sign));
-	float inv_tanh_smp = Interpolate(lut_inv_tanh, tanh_loopup,
-			static_cast<float>(LUT_INV_TANH_SIZE-1)) * sign;
-
-	smp = smp + (inv_tanh_smp - smp) * fac;
-	smp *= amp;
-	smp = std::max(-1.0f, std::min(1.0f, smp));
-	*in = smp;
-}
-
-
 void GranularProcessor::Process(
-    ShortFrame* input,
-    ShortFrame* output,
-    size_t size) {
+    const short* input,
+    short* output,
+    size_t size,
+    size_t stride) {
   // TIC
+  if (prepare_schedule_ == PREPARE_SCHEDULE_BUDGET) {
+    prepare_credit_ += prepare_budget_;
+  }
+
   if (bypass_) {
-    copy(&input[0], &input[size], &output[0]);
+    for (size_t i = 0; i < size * 2; ++i) {
+      output[i * stride] = input[i * stride];
+    }
+    control_samples_ = 0;
     return;
   }
 
   if (silence_ || reset_buffers_ ||
       previous_playback_mode_ != playback_mode_) {
-    short* output_samples = &output[0].l;
-    fill(&output_samples[0], &output_samples[size * 2], 0);
+    for (size_t i = 0; i < size * 2; ++i) {
+      output[i * stride] = 0;
+    }
+    control_samples_ = 0;
     return;
   }
 
+  // Parameter mapping and filter coefficient updates run once every
+  // kControlBlockSize samples, whatever the size of the codec blocks.
+  update_controls_ = control_samples_ <= 0;
+  if (update_controls_) {
+    control_samples_ += kControlBlockSize;
+  }
+  control_samples_ -= size;
+
   // Convert input buffers to float
+  const short* input_samples = input;
   for (size_t i = 0; i < size; ++i) {
-    in_[i].l = static_cast<float>(input[i].l) / 32768.0f;
-    in_[i].r = static_cast<float>(input[i].r) / 32768.0f;
+    in_[i].l = static_cast<float>(input_samples[0]) / 32768.0f;
+    in_[i].r = static_cast<float>(input_samples[stride]) / 32768.0f;
+    input_samples += 2 * stride;
   }
 
   // SUPERCELL Handle Mute In separately
@@ -373,35 +408,50 @@ void GranularProcessor::Process(
 
   // Apply feedback, with high-pass filtering to prevent build-ups at very
   // low frequencies (causing large DC swings).
-  float feedback =
+  bool filter_feedback = playback_mode_ != PLAYBACK_MODE_OLIVERB &&
+      playback_mode_ != PLAYBACK_MODE_RESONESTOR &&
+      playback_mode_ != PLAYBACK_MODE_KAMMERL &&
+      playback_mode_ != PLAYBACK_MODE_SPECTRAL_CLOUD;
+  if (update_controls_) {
+    feedback_ =
 		  (playback_mode_ == PLAYBACK_MODE_KAMMERL
 				  && kammerl_.isSlicePlaybackActive()) ?
 				  parameters_.reverb : 0.0f; // Map reverb parameter to feedback in PLAYBACK_MODE_KAMMERL.
-  if (playback_mode_ != PLAYBACK_MODE_OLIVERB &&
-      playback_mode_ != PLAYBACK_MODE_RESONESTOR &&
-      playback_mode_ != PLAYBACK_MODE_KAMMERL &&
-      playback_mode_ != PLAYBACK_MODE_SPECTRAL_CLOUD) {
-	ONE_POLE(freeze_lp_, parameters_.freeze ? 1.0f : 0.0f, 0.0005f)
-	feedback = parameters_.feedback;
-	float cutoff = (20.0f + 100.0f * feedback * feedback) / sample_rate();
-	fb_filter_[0].set_f_q<FREQUENCY_FAST>(cutoff, 1.0f);
-	fb_filter_[1].set(fb_filter_[0]);
+    if (filter_feedback) {
+	  ONE_POLE(freeze_lp_, parameters_.freeze ? 1.0f : 0.0f, 0.0005f)
+	  feedback_ = parameters_.feedback;
+	  float cutoff = (20.0f + 100.0f * feedback_ * feedback_) / sample_rate();
+	  fb_filter_[0].set_f_q<FREQUENCY_FAST>(cutoff, 1.0f);
+	  fb_filter_[1].set(fb_filter_[0]);
+    }
+    fb_gain_ = feedback_ * (1.0f - freeze_lp_);
+  }
+  // Without a recording of its own, the input is only used as the dry
+  // signal: there is no need to feed back or downsample it.
+  const bool record = recording_source_ == NULL;
+  if (filter_feedback && record) {
 	fb_filter_[0].Process<FILTER_MODE_HIGH_PASS>(&fb_[0].l, &fb_[0].l, size, 2);
 	fb_filter_[1].Process<FILTER_MODE_HIGH_PASS>(&fb_[0].r, &fb_[0].r, size, 2);
   }
-  float fb_gain = feedback * (1.0f - freeze_lp_);
-  for (size_t i = 0; i < size; ++i) {
-	in_[i].l += fb_gain * (
-		SoftLimit(fb_gain * 1.4f * fb_[i].l + in_[i].l) - in_[i].l);
-	in_[i].r += fb_gain * (
-		SoftLimit(fb_gain * 1.4f * fb_[i].r + in_[i].r) - in_[i].r);
+  if (record) {
+    kernels_->soft_limit_mix(
+        &fb_[0].l, fb_gain_ * 1.4f, fb_gain_, &in_[0].l, size * 2);
   }
 
   if (low_fidelity_) {
     size_t downsampled_size = size / kDownsamplingFactor;
-    src_down_.Process(in_, in_downsampled_,size);
+    bool iir = resampler_[quality()] == RESAMPLER_IIR;
+    if (record && iir) {
+      iir_src_down_.Process(in_, in_downsampled_, size);
+    } else if (record) {
+      src_down_.Process(in_, in_downsampled_, size);
+    }
     ProcessGranular(in_downsampled_, out_downsampled_, downsampled_size);
-    src_up_.Process(out_downsampled_, out_, downsampled_size);
+    if (iir) {
+      iir_src_up_.Process(out_downsampled_, out_, downsampled_size);
+    } else {
+      src_up_.Process(out_downsampled_, out_, downsampled_size);
+    }
   } else {
     ProcessGranular(in_, out_, size);
   }
@@ -412,34 +462,38 @@ void GranularProcessor::Process(
       playback_mode_ != PLAYBACK_MODE_OLIVERB &&
       playback_mode_ != PLAYBACK_MODE_RESONESTOR &&
       playback_mode_ != PLAYBACK_MODE_KAMMERL) {
-    float texture = parameters_.texture;
-    float diffusion = playback_mode_ == PLAYBACK_MODE_GRANULAR
-        ? texture > 0.75f ? (texture - 0.75f) * 4.0f : 0.0f
-        : parameters_.density;
-    diffuser_.set_amount(diffusion);
+    if (update_controls_) {
+      float texture = parameters_.texture;
+      float diffusion = playback_mode_ == PLAYBACK_MODE_GRANULAR
+          ? texture > 0.75f ? (texture - 0.75f) * 4.0f : 0.0f
+          : parameters_.density;
+      diffuser_.set_amount(diffusion);
+    }
     diffuser_.Process(out_, size);
   }
 
   if (((playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY)
       && (!parameters_.freeze || looper_.synchronized()))
       || (playback_mode_ == PLAYBACK_MODE_SPECTRAL_CLOUD)) {
-    pitch_shifter_.set_ratio(SemitonesToRatio(parameters_.pitch));
-    pitch_shifter_.set_size(parameters_.size);
-    if (PLAYBACK_MODE_SPECTRAL_CLOUD != playback_mode_) {
-      // parasites
-      float x = parameters_.pitch;
-      const float limit = 0.7f;
-      const float slew = 0.4f;
-      float wet =
-        x < -limit ? 1.0f :
-        x < -limit + slew ? 1.0f - (x + limit) / slew:
-        x < limit - slew ? 0.0f :
-        x < limit ? 1.0f + (x - limit) / slew:
-        1.0f;
-      pitch_shifter_.set_dry_wet(wet);
-    } else {
-      // beat repeat
-      pitch_shifter_.set_dry_wet(1.f);
+    if (update_controls_) {
+      pitch_shifter_.set_ratio(SemitonesToRatio(parameters_.pitch));
+      pitch_shifter_.set_size(parameters_.size);
+      if (PLAYBACK_MODE_SPECTRAL_CLOUD != playback_mode_) {
+        // parasites
+        float x = parameters_.pitch;
+        const float limit = 0.7f;
+        const float slew = 0.4f;
+        float wet =
+          x < -limit ? 1.0f :
+          x < -limit + slew ? 1.0f - (x + limit) / slew:
+          x < limit - slew ? 0.0f :
+          x < limit ? 1.0f + (x - limit) / slew:
+          1.0f;
+        pitch_shifter_.set_dry_wet(wet);
+      } else {
+        // beat repeat
+        pitch_shifter_.set_dry_wet(1.f);
+      }
     }
     pitch_shifter_.Process(out_, size);
   }
@@ -447,27 +501,28 @@ void GranularProcessor::Process(
   // Apply filters.
   if (playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY ||
       playback_mode_ == PLAYBACK_MODE_STRETCH) {
-    float cutoff = parameters_.texture;
-    float lp_cutoff = 0.5f * SemitonesToRatio(
-        (cutoff < 0.5f ? cutoff - 0.5f : 0.0f) * 216.0f);
-    float hp_cutoff = 0.25f * SemitonesToRatio(
-        (cutoff < 0.5f ? -0.5f : cutoff - 1.0f) * 216.0f);
-    CONSTRAIN(lp_cutoff, 0.0f, 0.499f);
-    CONSTRAIN(hp_cutoff, 0.0f, 0.499f);
-
-    lp_filter_[0].set_f_q<FREQUENCY_FAST>(lp_cutoff, 0.9f);
+    if (update_controls_) {
+      float cutoff = parameters_.texture;
+      float lp_cutoff = 0.5f * SemitonesToRatio(
+          (cutoff < 0.5f ? cutoff - 0.5f : 0.0f) * 216.0f);
+      float hp_cutoff = 0.25f * SemitonesToRatio(
+          (cutoff < 0.5f ? -0.5f : cutoff - 1.0f) * 216.0f);
+      CONSTRAIN(lp_cutoff, 0.0f, 0.499f);
+      CONSTRAIN(hp_cutoff, 0.0f, 0.499f);
+
+      lp_filter_[0].set_f_q<FREQUENCY_FAST>(lp_cutoff, 0.9f);
+      lp_filter_[1].set(lp_filter_[0]);
+      hp_filter_[0].set_f_q<FREQUENCY_FAST>(hp_cutoff, 0.9f);
+      hp_filter_[1].set(hp_filter_[0]);
+    }
+
     lp_filter_[0].Process<FILTER_MODE_LOW_PASS>(
         &out_[0].l, &out_[0].l, size, 2);
-
-    lp_filter_[1].set(lp_filter_[0]);
     lp_filter_[1].Process<FILTER_MODE_LOW_PASS>(
         &out_[0].r, &out_[0].r, size, 2);
 
-    hp_filter_[0].set_f_q<FREQUENCY_FAST>(hp_cutoff, 0.9f);
     hp_filter_[0].Process<FILTER_MODE_HIGH_PASS>(
         &out_[0].l, &out_[0].l, size, 2);
-
-    hp_filter_[1].set(hp_filter_[0]);
     hp_filter_[1].Process<FILTER_MODE_HIGH_PASS>(
         &out_[0].r, &out_[0].r, size, 2);
   }
@@ -484,18 +539,21 @@ void GranularProcessor::Process(
       out_[i].r *= mute_out_fade_;
   }
 
-  if (!reverb_dry_signal_ &&
-      playback_mode_ != PLAYBACK_MODE_OLIVERB &&
-      playback_mode_ != PLAYBACK_MODE_RESONESTOR &&
-      playback_mode_ != PLAYBACK_MODE_KAMMERL) {
-    // Apply reverb.
+  if (update_controls_) {
     float reverb_amount = parameters_.reverb;
 
     reverb_.set_amount(reverb_amount * 0.54f);
     reverb_.set_diffusion(0.7f);
     reverb_.set_time(0.35f + 0.63f * reverb_amount);
     reverb_.set_input_gain(0.2f);
-    reverb_.set_lp(0.6f + 0.37f * feedback);
+    reverb_.set_lp(0.6f + 0.37f * feedback_);
+  }
+
+  if (!reverb_dry_signal_ &&
+      playback_mode_ != PLAYBACK_MODE_OLIVERB &&
+      playback_mode_ != PLAYBACK_MODE_RESONESTOR &&
+      playback_mode_ != PLAYBACK_MODE_KAMMERL) {
+    // Apply reverb.
     reverb_.Process(out_, size);
   }
 
@@ -503,12 +561,20 @@ void GranularProcessor::Process(
 
   if (playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
 
-    ParameterInterpolator dry_wet_mod(&dry_wet_, parameters_.dry_wet, size);
+    if (update_controls_) {
+      dry_wet_increment_ = (parameters_.dry_wet - dry_wet_) /
+          static_cast<float>(kControlBlockSize);
+      dry_wet_ramp_ = kControlBlockSize;
+    }
     float mute_out_fade = original_mute_out_fade;
     float mute_in_fade = original_mute_in_fade;
 
     for (size_t i = 0; i < size; ++i) {
-      float dry_wet = dry_wet_mod.Next();
+      if (dry_wet_ramp_) {
+        dry_wet_ += dry_wet_increment_;
+        --dry_wet_ramp_;
+      }
+      float dry_wet = dry_wet_;
       if (playback_mode_ == PLAYBACK_MODE_KAMMERL) {
         dry_wet = 1.0f;
       }
@@ -517,8 +583,8 @@ void GranularProcessor::Process(
       float fade_out = Interpolate(lut_xfade_out, dry_wet, 16.0f);
 
       // Convert again from input, as in_ has feedback already applied
-      float l = static_cast<float>(input[i].l) / 32768.0f;
-      float r = static_cast<float>(input[i].r) / 32768.0f;
+      float l = static_cast<float>(input[2 * i * stride]) / 32768.0f;
+      float r = static_cast<float>(input[(2 * i + 1) * stride]) / 32768.0f;
 
       // Since the data here has bypassed all the mute logic, reapply mutes
       ONE_POLE(mute_out_fade, mute_level_out, 0.01f);
@@ -535,25 +601,16 @@ void GranularProcessor::Process(
       playback_mode_ != PLAYBACK_MODE_OLIVERB &&
       playback_mode_ != PLAYBACK_MODE_RESONESTOR &&
       playback_mode_ != PLAYBACK_MODE_KAMMERL) {
-    float reverb_amount = parameters_.reverb;
-
-    reverb_.set_amount(reverb_amount * 0.54f);
-    reverb_.set_diffusion(0.7f);
-    reverb_.set_time(0.35f + 0.63f * reverb_amount);
-    reverb_.set_input_gain(0.2f);
-    reverb_.set_lp(0.6f + 0.37f * feedback);
-
     reverb_.Process(out_, size);
   }
 
-  for (size_t i = 0; i < size; ++i) {
-    if (playback_mode_ == PLAYBACK_MODE_SPECTRAL_CLOUD) {
-	    WarmDistortion(&out_[i].l, parameters_.kammerl.pitch_mode);
-	    WarmDistortion(&out_[i].r, parameters_.kammerl.pitch_mode);
-    }
-
-    output[i].l = SoftConvert(out_[i].l);
-    output[i].r = SoftConvert(out_[i].r);
+  if (playback_mode_ == PLAYBACK_MODE_SPECTRAL_CLOUD) {
+    WarmDistortionBlock(&out_[0].l, size * 2, parameters_.kammerl.pitch_mode);
+  }
+  if (stride == 1) {
+    kernels_->soft_convert(&out_[0].l, output, size * 2);
+  } else {
+    SoftConvertBlock(&out_[0].l, output, size * 2, stride);
   }
 
   // TOC
@@ -588,50 +645,75 @@ void GranularProcessor::GetPersistentData(
     block->size = buffer_size_[num_channels_ - 1];
     ++block;
   }
+  if (extension_size_) {
+    block->tag = FourCC<'b', 'u', 'f', 'x'>::value;
+    block->data = extension_;
+    block->size = extension_size_;
+    ++block;
+  }
   *num_blocks = block - first_block;
 }
 
 bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
-  // Force a silent output while the swapping of buffers takes place.
-  silence_ = true;
-
   PersistentBlock block[4];
   size_t num_blocks;
   GetPersistentData(block, &num_blocks);
 
-  for (size_t i = 0; i < num_blocks; ++i) {
-    // Check that the format is correct.
-    if (block[i].tag != data[0] || block[i].size != data[1]) {
-      silence_ = false;
+  // Check the format of the state and of the audio buffers before touching
+  // anything, so that a failed load leaves the current recording intact. The
+  // size of the buffers only depends on the quality they were saved with.
+  if (block[0].tag != data[0] || block[0].size != data[1]) {
+    return false;
+  }
+  PersistentState state;
+  memcpy(&state, &data[2], sizeof(PersistentState));
+  const uint32_t* buffer_data = data + 2 + block[0].size / sizeof(uint32_t);
+  int32_t num_channels = state.quality & 1 ? 1 : 2;
+  size_t buffer_size = buffer_size_[num_channels - 1];
+  data = buffer_data;
+  for (int32_t i = 0; i < num_channels; ++i) {
+    if (block[1].tag != data[0] || buffer_size != data[1]) {
       return false;
     }
+    data += 2 + buffer_size / sizeof(uint32_t);
+  }
 
-    // All good. Load the data. 2 words have already been used for the block tag
-    // and the block size.
-    data += 2;
-    memcpy(block[i].data, data, block[i].size);
-    data += block[i].size / sizeof(uint32_t);
+  // Force a silent output while the swapping of buffers takes place.
+  silence_ = true;
+  persistent_state_ = state;
+
+  // We now know from which mode the data was saved.
+  uint8_t currently_spectral =
+      playback_mode_ == PLAYBACK_MODE_SPECTRAL ||
+      playback_mode_ == PLAYBACK_MODE_SPECTRAL_CLOUD
+      ? playback_mode_ : 0;
+  uint8_t requires_spectral = persistent_state_.spectral;
+  if (currently_spectral ^ requires_spectral) {
+    set_playback_mode(requires_spectral
+        ? static_cast<PlaybackMode>(requires_spectral)
+        : PLAYBACK_MODE_GRANULAR);
+  }
+  set_quality(persistent_state_.quality);
 
-    if (i == 0) {
-      // We now know from which mode the data was saved.
-      uint8_t currently_spectral =
-          playback_mode_ == PLAYBACK_MODE_SPECTRAL ||
-          playback_mode_ == PLAYBACK_MODE_SPECTRAL_CLOUD
-          ? playback_mode_ : 0;
-      uint8_t requires_spectral = persistent_state_.spectral;
-      if (currently_spectral ^ requires_spectral) {
-        set_playback_mode(requires_spectral
-            ? static_cast<PlaybackMode>(requires_spectral)
-            : PLAYBACK_MODE_GRANULAR);
-      }
-      set_quality(persistent_state_.quality);
+  // We can force a switch to this mode, and once everything has been
+  // initialized for this mode, copy the actual buffer data - with all state
+  // variables correctly initialized.
+  Prepare();
+  GetPersistentData(block, &num_blocks);
 
-      // We can force a switch to this mode, and once everything has been
-      // initialized for this mode, we continue with the loop to copy the
-      // actual buffer data - with all state variables correctly initialized.
-      Prepare();
-      GetPersistentData(block, &num_blocks);
+  data = buffer_data;
+  for (size_t i = 1; i < num_blocks; ++i) {
+    if (block[i].tag != data[0] || block[i].size != data[1]) {
+      // Only the second segment of a mono recording can be missing, from the
+      // saves made before it existed. It is cleared rather than left with
+      // stale audio.
+      memset(block[i].data, 0, block[i].size);
+      continue;
     }
+    // 2 words are used for the block tag and the block size.
+    data += 2;
+    memcpy(block[i].data, data, block[i].size);
+    data += block[i].size / sizeof(uint32_t);
   }
 
   // We can finally reset the position of the write heads.
@@ -642,6 +724,13 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
     buffer_16_[0].Resync(persistent_state_.write_head[0]);
     buffer_16_[1].Resync(persistent_state_.write_head[1]);
   }
+  for (int32_t i = 0; i < num_channels_; ++i) {
+    if (low_fidelity_) {
+      buffer_8_[i].RebuildPyramid();
+    } else {
+      buffer_16_[i].RebuildPyramid();
+    }
+  }
   parameters_.freeze = true;
   silence_ = false;
   return true;
@@ -676,7 +765,7 @@ void GranularProcessor::Prepare() {
     size_t workspace_size;
     if (num_channels_ == 1) {
       // Large buffer: 120k of sample memory.
-      // small buffer: fully allocated to FX workspace.
+      // small buffer: FX workspace, the rest extends the sample memory.
       buffer[0] = buffer_[0];
       buffer_size[0] = buffer_size_[0];
       buffer[1] = NULL;
@@ -695,23 +784,54 @@ void GranularProcessor::Prepare() {
     }
     float sr = sample_rate();
 
+    // Oliverb is the only mode using neither the diffuser nor the pitch
+    // shifter, and it cannot be reached through a benign change.
+    bool oliverb = playback_mode_ == PLAYBACK_MODE_OLIVERB;
     BufferAllocator allocator(workspace, workspace_size);
-    diffuser_.Init(allocator.Allocate<float>(2048));
+    if (!oliverb) {
+      diffuser_.Init(allocator.Allocate<float>(2048));
+    }
 
     uint16_t* reverb_buffer = allocator.Allocate<uint16_t>(16384);
-    if (playback_mode_ == PLAYBACK_MODE_OLIVERB) {
+    if (oliverb) {
       oliverb_.Init(reverb_buffer);
     } else {
       reverb_.Init(reverb_buffer);
     }
 
+    // The pitch shifter delay line (4096 shorts) shares its memory with the
+    // correlator, but is larger.
     size_t correlator_block_size = (kMaxWSOLASize / 32) + 2;
+    size_t correlator_data_size = correlator_block_size * 3;
+    if (!oliverb && correlator_data_size < 4096 / 2) {
+      correlator_data_size = 4096 / 2;
+    }
     uint32_t* correlator_data = allocator.Allocate<uint32_t>(
-        correlator_block_size * 3);
+        correlator_data_size);
     correlator_.Init(
         &correlator_data[0],
         &correlator_data[correlator_block_size]);
-    pitch_shifter_.Init((uint16_t*)correlator_data);
+    if (!oliverb) {
+      pitch_shifter_.Init((uint16_t*)correlator_data);
+    }
+
+    // In mono, the workspace not needed by the current mode becomes a second
+    // segment of sample memory. It is saved along with the first one, and
+    // is limited to what is left in a sample memory - which also gives the
+    // same recording length in all modes.
+    void* extension = NULL;
+    size_t extension_size = 0;
+    if (num_channels_ == 1) {
+      size_t overhead = sizeof(PersistentState) + 3 * 2 * sizeof(uint32_t);
+      size_t max_size = buffer_size[0] + overhead < kSampleMemorySize
+          ? kSampleMemorySize - buffer_size[0] - overhead
+          : 0;
+      extension_size = std::min(allocator.free(), max_size) / sizeof(uint32_t);
+      extension = allocator.Allocate<uint32_t>(extension_size);
+      extension_size *= sizeof(uint32_t);
+    }
+    extension_ = NULL;
+    extension_size_ = 0;
 
     if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
       phase_vocoder_.Init(
@@ -729,23 +849,36 @@ void GranularProcessor::Prepare() {
       float* buf = (float*)buffer[0];
       resonestor_.Init(buf);
     } else {
+      extension_ = extension;
+      extension_size_ = extension_size;
+      size_t pyramid_size = (pyramid_buffer_size_ / num_channels_) & ~3;
       for (int32_t i = 0; i < num_channels_; ++i) {
+        uint8_t* pyramid = pyramid_buffer_ + pyramid_size * i;
         if (resolution() == 8) {
           buffer_8_[i].Init(
               buffer[i],
-              (buffer_size[i]),
+              buffer_size[i],
+              extension,
+              extension_size,
               tail_buffer_[i]);
+          buffer_8_[i].InitPyramid(pyramid, pyramid_size);
         } else {
           buffer_16_[i].Init(
               buffer[i],
-              ((buffer_size[i]) >> 1),
+              buffer_size[i] / kHighResolutionSampleSize,
+              extension,
+              extension_size / kHighResolutionSampleSize,
               tail_buffer_[i]);
+          buffer_16_[i].InitPyramid(pyramid, pyramid_size);
         }
       }
 
       int32_t num_grains = (num_channels_ == 1 ? 40 : 32) *
          (low_fidelity_ ? 23 : 16) >> 4;
       player_.Init(num_channels_, num_grains);
+#ifdef GRAIN_THREADS
+      player_.set_worker_pool(worker_pool_);
+#endif  // GRAIN_THREADS
       ws_player_.Init(&correlator_, num_channels_);
       looper_.Init(num_channels_);
       kammerl_.Init(num_channels_);
@@ -754,15 +887,57 @@ void GranularProcessor::Prepare() {
     previous_playback_mode_ = playback_mode_;
   }
 
+  switch (prepare_schedule_) {
+    case PREPARE_SCHEDULE_SLICE:
+      PrepareSlice();
+      break;
+
+    case PREPARE_SCHEDULE_COMPLETE:
+      while (PreparePending()) {
+        PrepareSlice();
+      }
+      break;
+
+    case PREPARE_SCHEDULE_BUDGET:
+      while (prepare_credit_ >= 1.0f && PreparePending()) {
+        PrepareSlice();
+        prepare_credit_ -= 1.0f;
+      }
+      if (!PreparePending()) {
+        prepare_credit_ = 0.0f;
+      }
+      break;
+  }
+}
+
+// A new correlator search can only start from here, so it is loaded before
+// checking whether there is work left.
+bool GranularProcessor::PreparePending() {
+  if (playback_mode_ == PLAYBACK_MODE_SPECTRAL ||
+      playback_mode_ == PLAYBACK_MODE_SPECTRAL_CLOUD) {
+    return phase_vocoder_.backlog() != 0;
+  } else if (playback_mode_ == PLAYBACK_MODE_STRETCH ||
+             playback_mode_ == PLAYBACK_MODE_OLIVERB) {
+    if (resolution() == 8) {
+      ws_player_.LoadCorrelator(buffer_8());
+    } else {
+      ws_player_.LoadCorrelator(buffer_16());
+    }
+    return !correlator_.done();
+  }
+  return false;
+}
+
+void GranularProcessor::PrepareSlice() {
   if (playback_mode_ == PLAYBACK_MODE_SPECTRAL ||
       playback_mode_ == PLAYBACK_MODE_SPECTRAL_CLOUD) {
     phase_vocoder_.Buffer();
   } else if (playback_mode_ == PLAYBACK_MODE_STRETCH ||
              playback_mode_ == PLAYBACK_MODE_OLIVERB) {
     if (resolution() == 8) {
-      ws_player_.LoadCorrelator(buffer_8_);
+      ws_player_.LoadCorrelator(buffer_8());
     } else {
-      ws_player_.LoadCorrelator(buffer_16_);
+      ws_player_.LoadCorrelator(buffer_16());
     }
     correlator_.EvaluateSomeCandidates();
   }
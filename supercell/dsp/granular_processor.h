@@ -42,7 +42,9 @@
 #include "supercell/dsp/granular_processor.h"
 #include "supercell/dsp/granular_sample_player.h"
 #include "supercell/dsp/kammerl_player.h"
+#include "supercell/dsp/kernels.h"
 #include "supercell/dsp/looping_sample_player.h"
+#include "supercell/dsp/nonlinearity.h"
 #include "supercell/dsp/pvoc/phase_vocoder.h"
 #include "supercell/dsp/sample_rate_converter.h"
 #include "supercell/dsp/wsola_sample_player.h"
@@ -51,6 +53,21 @@ namespace clouds {
 
 const int32_t kDownsamplingFactor = 2;
 
+// Host builds can record the full quality signal as 32-bit floats, trading
+// twice as much memory per sample for no conversion and no clipping.
+#ifdef FLOAT_BUFFERS
+const Resolution kHighResolution = RESOLUTION_32_BIT_FLOAT;
+#else
+const Resolution kHighResolution = RESOLUTION_16_BIT;
+#endif  // FLOAT_BUFFERS
+
+const int32_t kHighResolutionSampleSize =
+    kHighResolution == RESOLUTION_32_BIT_FLOAT ? 4 : 2;
+
+// Parameter mapping and filter coefficient updates happen once every 32
+// samples (1kHz), even when the codec runs with smaller blocks.
+const int32_t kControlBlockSize = 32;
+
 enum PlaybackMode {
   PLAYBACK_MODE_GRANULAR,
   PLAYBACK_MODE_STRETCH,
@@ -63,6 +80,26 @@ enum PlaybackMode {
   PLAYBACK_MODE_LAST
 };
 
+// Filters for the decimation and interpolation in low fidelity mode.
+enum Resampler {
+  RESAMPLER_FIR,
+  RESAMPLER_IIR
+};
+
+// How much of the work left to Prepare() is done between two blocks. On the
+// module, this depends on how often the main loop gets to call it.
+enum PrepareSchedule {
+  // One slice of work per call: a share of the correlator search, or one
+  // STFT frame.
+  PREPARE_SCHEDULE_SLICE,
+  // Everything pending is done: the whole correlator search, and all the
+  // STFT frames ready.
+  PREPARE_SCHEDULE_COMPLETE,
+  // A fixed number of slices per block, possibly fractional, whatever the
+  // number of calls. Time left when there is nothing to do is lost.
+  PREPARE_SCHEDULE_BUDGET
+};
+
 // State of the recording buffer as saved in one of the 4 sample memories.
 struct PersistentState {
   int32_t write_head[2];
@@ -77,6 +114,9 @@ struct PersistentBlock {
   void* data;
 };
 
+// Each sample memory is a 128k flash sector.
+const size_t kSampleMemorySize = 0x20000;
+
 class GranularProcessor {
  public:
   GranularProcessor() { }
@@ -88,9 +128,65 @@ class GranularProcessor {
       void* small_buffer,
       size_t small_buffer_size);
 
-  void Process(ShortFrame* input, ShortFrame* output, size_t size);
+  // Processes size frames of interleaved stereo samples, consecutive samples
+  // being stride shorts apart. This allows the padded DMA buffers of the
+  // codec to be used directly.
+  void Process(
+      const short* input,
+      short* output,
+      size_t size,
+      size_t stride);
+
+  inline void Process(ShortFrame* input, ShortFrame* output, size_t size) {
+    Process(&input[0].l, &output[0].l, size, 1);
+  }
   void Prepare();
-  
+
+  // Memory for the decimated copies of the recording read by the players
+  // when transposing up. Takes effect when the buffers are next reset. This
+  // is for host builds only: the module has no RAM to spare for it and never
+  // calls this, so the pyramid stays disabled there. Writing and playback
+  // test for it once per block, not per sample.
+  inline void set_pyramid_buffer(void* buffer, size_t size) {
+    pyramid_buffer_ = static_cast<uint8_t*>(buffer);
+    pyramid_buffer_size_ = size;
+    reset_buffers_ = true;
+  }
+
+  // Plays from the recording buffers of another processor, instead of
+  // recording the input. Both processors must use the same quality, and one
+  // of the modes playing from the recording buffers (all but the spectral
+  // modes and the resonestor). The input is then only used as the dry signal,
+  // and feedback and freeze have no effect on the recording. The source must
+  // process each block before this processor does.
+  inline void set_recording_source(GranularProcessor* source) {
+    recording_source_ = source;
+  }
+
+  // Forces the instruction set of the block kernels, which is otherwise the
+  // fastest one supported by the CPU. Unsupported sets fall back to scalar.
+  inline void set_kernel_set(KernelSet set) {
+    kernels_ = &GetKernels(KernelSetSupported(set) ? set : KERNEL_SET_SCALAR);
+  }
+
+  inline const Kernels& kernels() const {
+    return *kernels_;
+  }
+
+  // In the spectral mode, FFT bins above this one are processed in bands.
+  // 0 processes all bins individually.
+  inline void set_spectral_crossover(int32_t bin) {
+    phase_vocoder_.set_crossover(bin);
+  }
+
+#ifdef GRAIN_THREADS
+  // Spreads the rendering of the grains over the workers of the pool.
+  inline void set_worker_pool(WorkerPool* worker_pool) {
+    worker_pool_ = worker_pool;
+    player_.set_worker_pool(worker_pool);
+  }
+#endif  // GRAIN_THREADS
+
   inline Parameters* mutable_parameters() {
     return &parameters_;
   }
@@ -120,6 +216,25 @@ class GranularProcessor {
     return parameters_.granular.reverse;
   }
 
+  // Snap the grains and beat-repeat slices to the nearest onset.
+  inline void set_snap_to_onsets(bool snap) {
+    parameters_.snap_to_onsets = snap;
+  }
+
+  inline bool snap_to_onsets() const {
+    return parameters_.snap_to_onsets;
+  }
+
+  // Go further back in time when a beat-repeat slice falls on silence, and
+  // don't start grains on silent parts of the recording.
+  inline void set_skip_silent_slices(bool skip) {
+    parameters_.skip_silent_slices = skip;
+  }
+
+  inline bool skip_silent_slices() const {
+    return parameters_.skip_silent_slices;
+  }
+
   inline void set_silence(bool silence) {
     silence_ = silence;
   }
@@ -177,6 +292,24 @@ class GranularProcessor {
     low_fidelity_ = low_fidelity;
   }
   
+  // Selects the filters used in low fidelity mode, for each of the 4
+  // qualities. The FIR filters have a linear phase, the IIR ones are cheaper.
+  inline void set_resampler(int32_t quality, Resampler resampler) {
+    resampler_[quality] = resampler;
+  }
+
+  // The slice schedule is the one of the firmware. The other two make
+  // offline renders independent of the number of calls to Prepare().
+  inline void set_prepare_schedule(PrepareSchedule schedule) {
+    prepare_schedule_ = schedule;
+    prepare_credit_ = 0.0f;
+  }
+  
+  // Slices of work per call to Process() in the budget schedule.
+  inline void set_prepare_budget(float budget) {
+    prepare_budget_ = budget;
+  }
+
   inline int32_t quality() const {
     int32_t quality = 0;
     if (num_channels_ == 1) quality |= 1;
@@ -184,13 +317,15 @@ class GranularProcessor {
     return quality;
   }
   
+  inline const PhaseVocoder& phase_vocoder() const {
+    return phase_vocoder_;
+  }
+  
   void GetPersistentData(PersistentBlock* block, size_t *num_blocks);
   bool LoadPersistentData(const uint32_t* data);
   void PreparePersistentData();
 
  private:
-  void WarmDistortion(float* in, float parameter);
-
   inline int32_t resolution() const {
     return low_fidelity_ ? 8 : 16;
   }
@@ -200,7 +335,17 @@ class GranularProcessor {
         (low_fidelity_ ? kDownsamplingFactor : 1);
   }
      
+  inline AudioBuffer<RESOLUTION_8_BIT_MU_LAW>* buffer_8() {
+    return recording_source_ ? recording_source_->buffer_8_ : buffer_8_;
+  }
+
+  inline AudioBuffer<kHighResolution>* buffer_16() {
+    return recording_source_ ? recording_source_->buffer_16_ : buffer_16_;
+  }
+
   void ResetFilters();
+  bool PreparePending();
+  void PrepareSlice();
   void ProcessGranular(FloatFrame* input, FloatFrame* output, size_t size);
 
   PlaybackMode playback_mode_;
@@ -219,9 +364,26 @@ class GranularProcessor {
 
   float freeze_lp_;
   float dry_wet_;
+  float dry_wet_increment_;
+  int32_t dry_wet_ramp_;
+
+  int32_t control_samples_;
+  bool update_controls_;
+  float feedback_;
+  float fb_gain_;
   
   void* buffer_[2];
   size_t buffer_size_[2];
+  uint8_t* pyramid_buffer_;
+  size_t pyramid_buffer_size_;
+  // Second segment of the mono recording, saved with the first one.
+  void* extension_;
+  size_t extension_size_;
+  GranularProcessor* recording_source_;
+  const Kernels* kernels_;
+#ifdef GRAIN_THREADS
+  WorkerPool* worker_pool_;
+#endif  // GRAIN_THREADS
   
   Correlator correlator_;
   
@@ -241,7 +403,7 @@ class GranularProcessor {
   stmlib::Svf lp_filter_[2];
   
   AudioBuffer<RESOLUTION_8_BIT_MU_LAW> buffer_8_[2];
-  AudioBuffer<RESOLUTION_16_BIT> buffer_16_[2];
+  AudioBuffer<kHighResolution> buffer_16_[2];
   
   FloatFrame in_[kMaxBlockSize];
   FloatFrame in_downsampled_[kMaxBlockSize / kDownsamplingFactor];
@@ -255,6 +417,15 @@ class GranularProcessor {
   
   SampleRateConverter<-kDownsamplingFactor, 45, src_filter_1x_2_45> src_down_;
   SampleRateConverter<+kDownsamplingFactor, 45, src_filter_1x_2_45> src_up_;
+  IirSampleRateConverter<-kDownsamplingFactor, 4, src_filter_iir_2_4>
+      iir_src_down_;
+  IirSampleRateConverter<+kDownsamplingFactor, 4, src_filter_iir_2_4>
+      iir_src_up_;
+  Resampler resampler_[4];
+  
+  PrepareSchedule prepare_schedule_;
+  float prepare_budget_;
+  float prepare_credit_;
   
   PersistentState persistent_state_;
   
@@ -41,6 +41,9 @@
 #include "supercell/dsp/frame.h"
 #include "supercell/dsp/grain.h"
 #include "supercell/dsp/parameters.h"
+#ifdef GRAIN_THREADS
+#include "supercell/dsp/worker_pool.h"
+#endif  // GRAIN_THREADS
 
 #include "supercell/resources.h"
 
@@ -48,6 +51,12 @@ namespace clouds {
 
 const int32_t kMaxNumGrains = 64;
 
+#ifdef GRAIN_THREADS
+// Below this number of active grains per worker, waking up the workers costs
+// more than rendering the grains on a single thread.
+const int32_t kMinGrainsPerWorker = 4;
+#endif  // GRAIN_THREADS
+
 using namespace stmlib;
 
 class GranularSamplePlayer {
@@ -65,26 +74,64 @@ class GranularSamplePlayer {
     num_grains_ = 0.0f;
     num_channels_ = num_channels;
     grain_size_hint_ = 1024.0f;
+    num_available_grains_ = max_num_grains;
+    gain_normalization_target_ = 1.0f;
+    target_num_grains_ = 0.0f;
+    seed_probability_ = 0.0f;
+    space_between_grains_ = 0.0f;
   }
   
-  template<Resolution resolution>
-  void Play(
-      const AudioBuffer<resolution>* buffer,
-      const Parameters& parameters,
-      float* out, size_t size) {
+#ifdef GRAIN_THREADS
+  // When set, the active grains are split between the workers of the pool,
+  // each of them rendering its share into a private accumulator. The result
+  // only depends on the number of workers, not on their scheduling.
+  inline void set_worker_pool(WorkerPool* worker_pool) {
+    worker_pool_ = worker_pool;
+  }
+#endif  // GRAIN_THREADS
+  
+  // Called at the start of each control block, before Play(). The grain
+  // density and the gain normalization only follow the grains which have
+  // been started or have ended at this rate, so that the rendering does not
+  // depend on the size of the blocks passed to Play().
+  void UpdateControls(const Parameters& parameters) {
+    // Compute normalization factor from the grains of the previous control
+    // block.
+    int32_t active_grains = max_num_grains_ - num_available_grains_;
+    SLOPE(num_grains_, static_cast<float>(active_grains), 0.9f, 0.2f);
+
+    float gain_normalization = num_grains_ > 2.0f
+        ? fast_rsqrt_carmack(num_grains_ - 1.0f)
+        : 1.0f;  
+    float window_gain = 1.0f + 2.0f * parameters.granular.window_shape;
+    CONSTRAIN(window_gain, 1.0f, 2.0f);
+    gain_normalization_target_ = gain_normalization * Crossfade(
+        1.0f, window_gain, parameters.granular.overlap);
+
     float overlap = parameters.granular.overlap;
     overlap = overlap * overlap * overlap;
-    float target_num_grains = max_num_grains_ * overlap;
-    float p = target_num_grains / static_cast<float>(grain_size_hint_);
-    float space_between_grains = grain_size_hint_ / target_num_grains;
+    target_num_grains_ = max_num_grains_ * overlap;
+    seed_probability_ = target_num_grains_ / grain_size_hint_;
+    space_between_grains_ = grain_size_hint_ / target_num_grains_;
     if (parameters.granular.use_deterministic_seed) {
-      p = -1.0f;
+      seed_probability_ = -1.0f;
     } else {
       grain_rate_phasor_ = -1000.0f;
     }
     
     // Build a list of available grains.
-    int32_t num_available_grains = FillAvailableGrainsList();
+    num_available_grains_ = FillAvailableGrainsList();
+  }
+  
+  template<Resolution resolution>
+  void Play(
+      const AudioBuffer<resolution>* buffer,
+      const Parameters& parameters,
+      float* out, size_t size) {
+    const float p = seed_probability_;
+    const float target_num_grains = target_num_grains_;
+    const float space_between_grains = space_between_grains_;
+    int32_t num_available_grains = num_available_grains_;
     
     // Try to schedule new grains.
     bool seed_trigger = parameters.trigger;
@@ -95,67 +142,47 @@ class GranularSamplePlayer {
       bool seed_deterministic = grain_rate_phasor_ >= space_between_grains;
       bool seed = seed_probabilistic || seed_deterministic || seed_trigger;
       if (num_available_grains && seed) {
-        --num_available_grains;
-        int32_t index = available_grains_[num_available_grains];
+        int32_t index = available_grains_[num_available_grains - 1];
         GrainQuality quality;
-        if (num_available_grains < num_midfi_grains_) {
+        if (num_available_grains - 1 < num_midfi_grains_) {
           quality = GRAIN_QUALITY_MEDIUM;
         } else {
           quality = GRAIN_QUALITY_HIGH;
         }
         
         Grain* g = &grains_[index];
-        ScheduleGrain(
+        bool started = ScheduleGrain(
             g,
             parameters,
             t,
             buffer->size(),
             buffer->head() - size + t,
+            buffer->onsets(),
+            buffer->chunks(),
             quality);
+        if (started) {
+          --num_available_grains;
+        }
         grain_rate_phasor_ = 0.0f;
         seed_trigger = false;
       }
     }
     
     // Overlap grains.
-    std::fill(&out[0], &out[size * 2], 0.0f);
-    float* e = envelope_buffer_;
-    for (int32_t i = 0; i < max_num_grains_; ++i) {
-      Grain* g = &grains_[i];
-      if (g->recommended_quality() == GRAIN_QUALITY_HIGH) {
-        if (num_channels_ == 1) {
-          g->OverlapAdd<1, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
-        } else {
-          g->OverlapAdd<2, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
-        }
-      } else if (g->recommended_quality() == GRAIN_QUALITY_MEDIUM) {
-        if (num_channels_ == 1) {
-          g->OverlapAdd<1, GRAIN_QUALITY_MEDIUM>(buffer, out, e, size);
-        } else {
-          g->OverlapAdd<2, GRAIN_QUALITY_MEDIUM>(buffer, out, e, size);
-        }
-      } else {
-        if (num_channels_ == 1) {
-          g->OverlapAdd<1, GRAIN_QUALITY_LOW>(buffer, out, e, size);
-        } else {
-          g->OverlapAdd<2, GRAIN_QUALITY_LOW>(buffer, out, e, size);
-        }
-      }
+#ifdef GRAIN_THREADS
+    if (worker_pool_ && worker_pool_->num_workers() > 1) {
+      OverlapAddParallel(buffer, out, size);
+    } else {
+      OverlapAddSerial(buffer, out, size);
     }
+#else
+    OverlapAddSerial(buffer, out, size);
+#endif  // GRAIN_THREADS
+    
+    num_available_grains_ = num_available_grains;
     
-    // Compute normalization factor.
-    int32_t active_grains = max_num_grains_ - num_available_grains;
-    SLOPE(num_grains_, static_cast<float>(active_grains), 0.9f, 0.2f);
-
-    float gain_normalization = num_grains_ > 2.0f
-        ? fast_rsqrt_carmack(num_grains_ - 1.0f)
-        : 1.0f;  
-    float window_gain = 1.0f + 2.0f * parameters.granular.window_shape;
-    CONSTRAIN(window_gain, 1.0f, 2.0f);
-    gain_normalization *= Crossfade(
-        1.0f, window_gain, parameters.granular.overlap);
-
     // Apply gain normalization.
+    const float gain_normalization = gain_normalization_target_;
     for (size_t t = 0; t < size; ++t) {
       ONE_POLE(gain_normalization_, gain_normalization, 0.01f)
       *out++ *= gain_normalization_;
@@ -164,6 +191,126 @@ class GranularSamplePlayer {
   }
   
  private:
+  template<Resolution resolution>
+  inline void OverlapAdd(
+      const AudioBuffer<resolution>* buffer,
+      Grain* g,
+      float* out,
+      float* envelope,
+      size_t size) {
+    if (g->recommended_quality() == GRAIN_QUALITY_HIGH) {
+      if (num_channels_ == 1) {
+        g->OverlapAdd<1, GRAIN_QUALITY_HIGH>(buffer, out, envelope, size);
+      } else {
+        g->OverlapAdd<2, GRAIN_QUALITY_HIGH>(buffer, out, envelope, size);
+      }
+    } else if (g->recommended_quality() == GRAIN_QUALITY_MEDIUM) {
+      if (num_channels_ == 1) {
+        g->OverlapAdd<1, GRAIN_QUALITY_MEDIUM>(buffer, out, envelope, size);
+      } else {
+        g->OverlapAdd<2, GRAIN_QUALITY_MEDIUM>(buffer, out, envelope, size);
+      }
+    } else {
+      if (num_channels_ == 1) {
+        g->OverlapAdd<1, GRAIN_QUALITY_LOW>(buffer, out, envelope, size);
+      } else {
+        g->OverlapAdd<2, GRAIN_QUALITY_LOW>(buffer, out, envelope, size);
+      }
+    }
+  }
+  
+  template<Resolution resolution>
+  void OverlapAddSerial(
+      const AudioBuffer<resolution>* buffer,
+      float* out,
+      size_t size) {
+    std::fill(&out[0], &out[size * 2], 0.0f);
+    for (int32_t i = 0; i < max_num_grains_; ++i) {
+      OverlapAdd(buffer, &grains_[i], out, envelope_buffer_, size);
+    }
+  }
+  
+#ifdef GRAIN_THREADS
+  template<Resolution resolution>
+  struct OverlapAddJob {
+    GranularSamplePlayer* player;
+    const AudioBuffer<resolution>* buffer;
+    float* out;
+    size_t size;
+    int32_t num_grains;
+    int32_t num_workers;
+    
+    static void Run(void* context, int32_t worker) {
+      OverlapAddJob* job = static_cast<OverlapAddJob*>(context);
+      GranularSamplePlayer* player = job->player;
+      if (worker >= job->num_workers) {
+        return;
+      }
+
+      // Worker 0 writes directly to the output, the others to their own
+      // accumulator.
+      float* out = worker ? player->accumulator_[worker] : job->out;
+      std::fill(&out[0], &out[job->size * 2], 0.0f);
+      
+      // Each worker takes a contiguous share of the list of active grains.
+      int32_t first = job->num_grains * worker / job->num_workers;
+      int32_t last = job->num_grains * (worker + 1) / job->num_workers;
+      float* envelope = player->worker_envelope_buffer_[worker];
+      for (int32_t i = first; i < last; ++i) {
+        Grain* g = &player->grains_[player->active_grains_[i]];
+        player->OverlapAdd(job->buffer, g, out, envelope, job->size);
+      }
+    }
+  };
+  
+  template<Resolution resolution>
+  void OverlapAddParallel(
+      const AudioBuffer<resolution>* buffer,
+      float* out,
+      size_t size) {
+    // List the active grains, so that they can be evenly split between the
+    // workers.
+    int32_t num_active_grains = 0;
+    for (int32_t i = 0; i < max_num_grains_; ++i) {
+      if (grains_[i].active()) {
+        active_grains_[num_active_grains] = i;
+        ++num_active_grains;
+      }
+    }
+    
+    int32_t num_workers = std::min(
+        worker_pool_->num_workers(),
+        num_active_grains / kMinGrainsPerWorker);
+    if (num_workers <= 1) {
+      std::fill(&out[0], &out[size * 2], 0.0f);
+      for (int32_t i = 0; i < num_active_grains; ++i) {
+        Grain* g = &grains_[active_grains_[i]];
+        OverlapAdd(buffer, g, out, envelope_buffer_, size);
+      }
+      return;
+    }
+    
+    OverlapAddJob<resolution> job;
+    job.player = this;
+    job.buffer = buffer;
+    job.out = out;
+    job.size = size;
+    job.num_grains = num_active_grains;
+    job.num_workers = num_workers;
+    worker_pool_->Run(&OverlapAddJob<resolution>::Run, &job);
+    
+    // Sum the accumulators, always in the same order. This is a plain scalar
+    // loop: at most 7 x 64 additions per block, next to the rendering of the
+    // grains.
+    for (int32_t i = 1; i < num_workers; ++i) {
+      const float* accumulator = accumulator_[i];
+      for (size_t j = 0; j < size * 2; ++j) {
+        out[j] += accumulator[j];
+      }
+    }
+  }
+#endif  // GRAIN_THREADS
+  
   int32_t FillAvailableGrainsList() {
     int32_t num_available_grains = 0;
     for (int32_t i = 0; i < max_num_grains_; ++i) {
@@ -175,12 +322,15 @@ class GranularSamplePlayer {
     return num_available_grains;
   }
   
-  void ScheduleGrain(
+  // Returns false if the grain has not been started, leaving it available.
+  bool ScheduleGrain(
       Grain* grain,
       const Parameters& parameters,
       int32_t pre_delay,
       int32_t buffer_size,
       int32_t buffer_head,
+      const OnsetIndex& onsets,
+      const ChunkIndex& chunks,
       GrainQuality quality) {
     float position = parameters.position;
     float pitch = parameters.pitch;
@@ -223,6 +373,24 @@ class GranularSamplePlayer {
     int32_t size = static_cast<int32_t>(grain_size) & ~1;
     int32_t start = buffer_head - static_cast<int32_t>(
         position * available + eaten_by_play_head);
+    if (parameters.snap_to_onsets) {
+      // Move the grain back to the previous onset, if there is one close
+      // enough and if the grain can still be played without being caught up
+      // by the recording head.
+      int32_t distance = onsets.DistanceToOnset(
+          start,
+          static_cast<int32_t>((1.0f - position) * available));
+      if (distance > 0) {
+        start -= distance;
+      }
+    }
+    ONE_POLE(grain_size_hint_, grain_size, 0.1f);
+
+    // Don't waste a grain on a silent part of the recording.
+    if (parameters.skip_silent_slices &&
+        chunks.IsSilent(start, static_cast<int32_t>(eaten_by_play_head))) {
+      return false;
+    }
     grain->Start(
         pre_delay,
         buffer_size,
@@ -234,8 +402,7 @@ class GranularSamplePlayer {
         gain_l,
         gain_r,
         quality);
-
-    ONE_POLE(grain_size_hint_, grain_size, 0.1f);
+    return true;
   }
   
   int32_t max_num_grains_;
@@ -247,10 +414,24 @@ class GranularSamplePlayer {
   float grain_size_hint_;
   float grain_rate_phasor_;
   
+  // Updated once per control block.
+  int32_t num_available_grains_;
+  float gain_normalization_target_;
+  float target_num_grains_;
+  float seed_probability_;
+  float space_between_grains_;
+  
   Grain grains_[kMaxNumGrains];
   int32_t available_grains_[kMaxNumGrains];
   float envelope_buffer_[kMaxBlockSize];
   
+#ifdef GRAIN_THREADS
+  WorkerPool* worker_pool_;
+  int32_t active_grains_[kMaxNumGrains];
+  float accumulator_[kMaxNumWorkers][kMaxBlockSize * 2];
+  float worker_envelope_buffer_[kMaxNumWorkers][kMaxBlockSize];
+#endif  // GRAIN_THREADS
+  
   DISALLOW_COPY_AND_ASSIGN(GranularSamplePlayer);
 };
 
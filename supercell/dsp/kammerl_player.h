@@ -149,12 +149,7 @@ public:
 	template<Resolution resolution>
 	void Play(const AudioBuffer<resolution>* buffer,
 			const Parameters& parameters, float* out, size_t size) {
-		int32_t max_delay = buffer->size() - 4;
-		num_samples_since_trigger_ += size;
-		if (num_samples_since_trigger_ > max_delay) {
-			num_samples_since_trigger_ = 0;
-			playback_mode_ = PLAYBACK_MODE_BYPASS;
-		}
+		const int32_t max_delay = buffer->size() - 4;
 		if (parameters.trigger
 				|| playback_mode_ == PLAYBACK_MODE_UNINITIALIZED) {
 			const int32_t latest_trigger_interval_samples =
@@ -196,6 +191,30 @@ public:
 						+ buffer->size();
 				slice_buffer_pos_index_ += buffer->size()
 						- num_samples_back_in_time;
+
+				// Go further back in time if nothing was recorded in this slice.
+				if (parameters.skip_silent_slices) {
+					int32_t candidate = slice_buffer_pos_index_;
+					for (int i = 0; i < kNumMaxSlices && slice_size_samples_ > 0
+							&& num_samples_back_in_time + i * slice_size_samples_
+									< buffer->size(); ++i) {
+						if (!buffer->chunks().IsSilent(candidate,
+								slice_size_samples_)) {
+							slice_buffer_pos_index_ = candidate;
+							break;
+						}
+						candidate -= slice_size_samples_;
+					}
+				}
+
+				// Move the slice start back to the previous onset.
+				if (parameters.snap_to_onsets) {
+					const int32_t distance = buffer->onsets().DistanceToOnset(
+							slice_buffer_pos_index_, slice_size_samples_ >> 2);
+					if (distance > 0) {
+						slice_buffer_pos_index_ -= distance;
+					}
+				}
 				slice_buffer_pos_index_ <<= 12;
 
 				// Initialize slice play head position.
@@ -233,6 +252,13 @@ public:
 			const int32_t buffer_playback_head = buffer->head() - 4 - size
 					+ buffer->size();
 
+			// Counted per sample, so that neither the trigger interval nor
+			// the return to bypass depend on the block size.
+			if (++num_samples_since_trigger_ > max_delay) {
+				num_samples_since_trigger_ = 0;
+				playback_mode_ = PLAYBACK_MODE_BYPASS;
+			}
+
 			// Calculate the playback percentage of current slice.
 			float slice_remaining_percentage = 0.0f;
 			if (slice_size_samples_ != 0) {
@@ -0,0 +1,274 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Block kernels with several implementations, one per instruction set.
+
+#include "supercell/dsp/kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CLOUDS_X86_KERNELS
+#include <immintrin.h>
+#endif  // __x86_64__ || __i386__
+
+#include "supercell/dsp/nonlinearity.h"
+
+namespace clouds {
+
+// The vectorized kernels compute SoftLimit as s * (27 + s * s) /
+// (27 + (9 * s) * s), in the same order as the scalar code, so that the
+// results are identical. The remaining samples go through the scalar code.
+
+static void SoftLimitMixScalar(
+    const float* x,
+    float gain,
+    float amount,
+    float* in_out,
+    size_t size) {
+  SoftLimitMixBlock(x, gain, amount, in_out, size);
+}
+
+static void SoftConvertScalar(const float* in, short* out, size_t size) {
+  SoftConvertBlock(in, out, size);
+}
+
+#ifdef CLOUDS_X86_KERNELS
+
+// SSE2.
+
+__attribute__((target("sse2")))
+static inline __m128 SoftLimitSse2(__m128 s) {
+  const __m128 k27 = _mm_set1_ps(27.0f);
+  const __m128 k9 = _mm_set1_ps(9.0f);
+  __m128 num = _mm_mul_ps(s, _mm_add_ps(k27, _mm_mul_ps(s, s)));
+  __m128 den = _mm_add_ps(k27, _mm_mul_ps(_mm_mul_ps(k9, s), s));
+  return _mm_div_ps(num, den);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i SoftConvert4Sse2(const float* in) {
+  __m128 x = _mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(0.5f));
+  __m128 s = _mm_mul_ps(SoftLimitSse2(x), _mm_set1_ps(32768.0f));
+  s = _mm_max_ps(s, _mm_set1_ps(-32768.0f));
+  s = _mm_min_ps(s, _mm_set1_ps(32767.0f));
+  return _mm_cvttps_epi32(s);
+}
+
+__attribute__((target("sse2")))
+static void SoftLimitMixSse2(
+    const float* x,
+    float gain,
+    float amount,
+    float* in_out,
+    size_t size) {
+  if (amount == 0.0f) {
+    return;
+  }
+  const __m128 g = _mm_set1_ps(gain);
+  const __m128 a = _mm_set1_ps(amount);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m128 y = _mm_loadu_ps(&in_out[i]);
+    __m128 s = _mm_add_ps(_mm_mul_ps(g, _mm_loadu_ps(&x[i])), y);
+    y = _mm_add_ps(y, _mm_mul_ps(a, _mm_sub_ps(SoftLimitSse2(s), y)));
+    _mm_storeu_ps(&in_out[i], y);
+  }
+  SoftLimitMixBlock(&x[i], gain, amount, &in_out[i], size - i);
+}
+
+__attribute__((target("sse2")))
+static void SoftConvertSse2(const float* in, short* out, size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m128i a = SoftConvert4Sse2(&in[i]);
+    __m128i b = SoftConvert4Sse2(&in[i + 4]);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(&out[i]), _mm_packs_epi32(a, b));
+  }
+  SoftConvertBlock(&in[i], &out[i], size - i);
+}
+
+// AVX2.
+
+__attribute__((target("avx2")))
+static inline __m256 SoftLimitAvx2(__m256 s) {
+  const __m256 k27 = _mm256_set1_ps(27.0f);
+  const __m256 k9 = _mm256_set1_ps(9.0f);
+  __m256 num = _mm256_mul_ps(s, _mm256_add_ps(k27, _mm256_mul_ps(s, s)));
+  __m256 den = _mm256_add_ps(k27, _mm256_mul_ps(_mm256_mul_ps(k9, s), s));
+  return _mm256_div_ps(num, den);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i SoftConvert8Avx2(const float* in) {
+  __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in), _mm256_set1_ps(0.5f));
+  __m256 s = _mm256_mul_ps(SoftLimitAvx2(x), _mm256_set1_ps(32768.0f));
+  s = _mm256_max_ps(s, _mm256_set1_ps(-32768.0f));
+  s = _mm256_min_ps(s, _mm256_set1_ps(32767.0f));
+  return _mm256_cvttps_epi32(s);
+}
+
+__attribute__((target("avx2")))
+static void SoftLimitMixAvx2(
+    const float* x,
+    float gain,
+    float amount,
+    float* in_out,
+    size_t size) {
+  if (amount == 0.0f) {
+    return;
+  }
+  const __m256 g = _mm256_set1_ps(gain);
+  const __m256 a = _mm256_set1_ps(amount);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 y = _mm256_loadu_ps(&in_out[i]);
+    __m256 s = _mm256_add_ps(_mm256_mul_ps(g, _mm256_loadu_ps(&x[i])), y);
+    y = _mm256_add_ps(y, _mm256_mul_ps(a, _mm256_sub_ps(SoftLimitAvx2(s), y)));
+    _mm256_storeu_ps(&in_out[i], y);
+  }
+  SoftLimitMixBlock(&x[i], gain, amount, &in_out[i], size - i);
+}
+
+__attribute__((target("avx2")))
+static void SoftConvertAvx2(const float* in, short* out, size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m256i a = SoftConvert8Avx2(&in[i]);
+    __m256i b = SoftConvert8Avx2(&in[i + 8]);
+    // The packing works within each 128-bit lane: put the 64-bit groups
+    // back in order.
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]), packed);
+  }
+  SoftConvertBlock(&in[i], &out[i], size - i);
+}
+
+// AVX-512. The instruction set includes FMA: contracting the multiplications
+// and additions would change the results.
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static inline __m512 SoftLimitAvx512(__m512 s) {
+  const __m512 k27 = _mm512_set1_ps(27.0f);
+  const __m512 k9 = _mm512_set1_ps(9.0f);
+  __m512 num = _mm512_mul_ps(s, _mm512_add_ps(k27, _mm512_mul_ps(s, s)));
+  __m512 den = _mm512_add_ps(k27, _mm512_mul_ps(_mm512_mul_ps(k9, s), s));
+  return _mm512_div_ps(num, den);
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void SoftLimitMixAvx512(
+    const float* x,
+    float gain,
+    float amount,
+    float* in_out,
+    size_t size) {
+  if (amount == 0.0f) {
+    return;
+  }
+  const __m512 g = _mm512_set1_ps(gain);
+  const __m512 a = _mm512_set1_ps(amount);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 y = _mm512_loadu_ps(&in_out[i]);
+    __m512 s = _mm512_add_ps(_mm512_mul_ps(g, _mm512_loadu_ps(&x[i])), y);
+    y = _mm512_add_ps(
+        y, _mm512_mul_ps(a, _mm512_sub_ps(SoftLimitAvx512(s), y)));
+    _mm512_storeu_ps(&in_out[i], y);
+  }
+  SoftLimitMixBlock(&x[i], gain, amount, &in_out[i], size - i);
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void SoftConvertAvx512(const float* in, short* out, size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 x = _mm512_mul_ps(_mm512_loadu_ps(&in[i]), _mm512_set1_ps(0.5f));
+    __m512 s = _mm512_mul_ps(SoftLimitAvx512(x), _mm512_set1_ps(32768.0f));
+    // The zero-masked forms of the intrinsics are used with all lanes
+    // enabled: the unmasked ones trip -Wmaybe-uninitialized on some gcc
+    // versions.
+    const __mmask16 all = 0xffff;
+    s = _mm512_maskz_max_ps(all, s, _mm512_set1_ps(-32768.0f));
+    s = _mm512_maskz_min_ps(all, s, _mm512_set1_ps(32767.0f));
+    __m512i converted = _mm512_maskz_cvttps_epi32(all, s);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(&out[i]),
+        _mm512_maskz_cvtsepi32_epi16(all, converted));
+  }
+  SoftConvertBlock(&in[i], &out[i], size - i);
+}
+
+#endif  // CLOUDS_X86_KERNELS
+
+// Indexed by KernelSet. Without the x86 kernels, only the scalar set has
+// kernels.
+const Kernels kernel_sets[KERNEL_SET_LAST] = {
+  { "scalar", &SoftLimitMixScalar, &SoftConvertScalar },
+#ifdef CLOUDS_X86_KERNELS
+  { "sse2", &SoftLimitMixSse2, &SoftConvertSse2 },
+  { "avx2", &SoftLimitMixAvx2, &SoftConvertAvx2 },
+  { "avx512", &SoftLimitMixAvx512, &SoftConvertAvx512 },
+#else
+  { "sse2", NULL, NULL },
+  { "avx2", NULL, NULL },
+  { "avx512", NULL, NULL },
+#endif  // CLOUDS_X86_KERNELS
+};
+
+bool KernelSetSupported(KernelSet set) {
+#ifdef CLOUDS_X86_KERNELS
+  __builtin_cpu_init();
+  switch (set) {
+    case KERNEL_SET_SCALAR:
+      return true;
+    case KERNEL_SET_SSE2:
+      return __builtin_cpu_supports("sse2") != 0;
+    case KERNEL_SET_AVX2:
+      return __builtin_cpu_supports("avx2") != 0;
+    case KERNEL_SET_AVX512:
+      return __builtin_cpu_supports("avx512f") != 0;
+    default:
+      return false;
+  }
+#else
+  return set == KERNEL_SET_SCALAR;
+#endif  // CLOUDS_X86_KERNELS
+}
+
+KernelSet BestKernelSet() {
+  int32_t set = KERNEL_SET_LAST - 1;
+  while (set > KERNEL_SET_SCALAR &&
+         !KernelSetSupported(static_cast<KernelSet>(set))) {
+    --set;
+  }
+  return static_cast<KernelSet>(set);
+}
+
+const Kernels& GetKernels(KernelSet set) {
+  return kernel_sets[set];
+}
+
+}  // namespace clouds
@@ -0,0 +1,74 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Block kernels with several implementations, one per instruction set. On
+// x86 hosts, the fastest set supported by the CPU is picked at run time, so
+// that the same binary runs on all machines. Elsewhere, only the scalar
+// kernels are built.
+
+#ifndef CLOUDS_DSP_KERNELS_H_
+#define CLOUDS_DSP_KERNELS_H_
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+enum KernelSet {
+  KERNEL_SET_SCALAR,
+  KERNEL_SET_SSE2,
+  KERNEL_SET_AVX2,
+  KERNEL_SET_AVX512,
+  KERNEL_SET_LAST
+};
+
+// All the kernels of a set give exactly the same results as the scalar ones.
+struct Kernels {
+  const char* name;
+
+  // SoftLimitMixBlock.
+  void (*soft_limit_mix)(
+      const float* x,
+      float gain,
+      float amount,
+      float* in_out,
+      size_t size);
+
+  // SoftConvertBlock, without stride.
+  void (*soft_convert)(const float* in, short* out, size_t size);
+};
+
+// Whether the instruction set is built in and supported by the CPU.
+bool KernelSetSupported(KernelSet set);
+
+// The fastest supported instruction set.
+KernelSet BestKernelSet();
+
+// The kernels of a set can only be called if it is supported.
+const Kernels& GetKernels(KernelSet set);
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_KERNELS_H_
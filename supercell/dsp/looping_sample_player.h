@@ -112,21 +112,31 @@ class LoopingSamplePlayer {
     const float swap_channels = parameters.stereo_spread;
 
     if (!parameters.freeze) {
-      while (size--) {
-        float error = (target_delay - current_delay_);
-        float delay = current_delay_ + 0.0005f * error;
-        current_delay_ = delay;
-        int32_t delay_int = (buffer->head() - 4 - size + buffer->size()) << 12;
-        delay_int -= static_cast<int32_t>(delay * 4096.0f);
-        
-        float l = buffer[0].ReadHermite((delay_int >> 12), delay_int << 4);
-        if (num_channels_ == 1) {
-          *out++ = l;
-          *out++ = l;
-        } else if (num_channels_ == 2) {
-          float r = buffer[1].ReadHermite((delay_int >> 12), delay_int << 4);
-          *out++ = l + (r - l) * swap_channels;
-          *out++ = r + (l - r) * swap_channels;
+      // Compute the read positions for the whole block, then read them in
+      // one go. The delay slew is kept as a recursion rather than evaluated
+      // in closed form, so that the output doesn't depend on the block size.
+      float delay = current_delay_;
+      int32_t head = buffer->head() - 3 - size + buffer->size();
+      for (size_t i = 0; i < size; ++i) {
+        delay += 0.0005f * (target_delay - delay);
+        position_[i] = (head + static_cast<int32_t>(i)) << 12;
+        position_[i] -= static_cast<int32_t>(delay * 4096.0f);
+      }
+      current_delay_ = delay;
+      
+      float l[kMaxBlockSize];
+      buffer[0].ReadHermite(position_, l, size, 0);
+      if (num_channels_ == 1) {
+        for (size_t i = 0; i < size; ++i) {
+          *out++ = l[i];
+          *out++ = l[i];
+        }
+      } else if (num_channels_ == 2) {
+        float r[kMaxBlockSize];
+        buffer[1].ReadHermite(position_, r, size, 0);
+        for (size_t i = 0; i < size; ++i) {
+          *out++ = l[i] + (r[i] - l[i]) * swap_channels;
+          *out++ = r[i] + (l[i] - r[i]) * swap_channels;
         }
       }
       phase_ = 0.0f;
@@ -147,8 +157,15 @@ class LoopingSamplePlayer {
       float phase_increment = synchronized_
           ? 1.0f
           : SemitonesToRatio(parameters.pitch);
+      int32_t level = buffer->pyramid_level(
+          static_cast<int32_t>(phase_increment * 65536.0f));
 
-      while (size--) {
+      // Compute the read positions and crossfade gains for the whole block,
+      // then read the loop and the tail of the previous loop in one go.
+      int32_t delay_int = (buffer->head() - 4 + buffer->size()) << 12;
+      float gain[kMaxBlockSize];
+      bool crossfade = false;
+      for (size_t i = 0; i < size; ++i) {
         ONE_POLE(smoothed_tap_delay_, tap_delay_, 0.00001f);
 
         if (phase_ >= loop_duration_ || phase_ == 0.0f) {
@@ -168,45 +185,57 @@ class LoopingSamplePlayer {
         }
         phase_ += phase_increment;
         
-        float gain = 1.0f;
+        gain[i] = 1.0f;
         if (tail_duration_ != 0.0f) {
-          gain = phase_ / tail_duration_;
-          CONSTRAIN(gain, 0.0f, 1.0f);
+          gain[i] = phase_ / tail_duration_;
+          CONSTRAIN(gain[i], 0.0f, 1.0f);
         }
-        int32_t delay_int = (buffer->head() - 4 + buffer->size()) << 12;
 
         float ph = parameters.granular.reverse ?
           loop_duration_ - phase_ :
           phase_;
 
-        int32_t position = delay_int - static_cast<int32_t>(
+        position_[i] = delay_int - static_cast<int32_t>(
           (loop_duration_ - ph + loop_point_) * 4096.0f);
-        float l = buffer[0].ReadHermite((position >> 12), position << 4);
+        tail_position_[i] = delay_int - static_cast<int32_t>(
+              (-phase_ + tail_start_) * 4096.0f);
+        crossfade = crossfade || gain[i] != 1.0f;
+      }
+
+      float l[kMaxBlockSize];
+      float r[kMaxBlockSize];
+      buffer[0].ReadHermite(position_, l, size, level);
+      if (num_channels_ == 2) {
+        buffer[1].ReadHermite(position_, r, size, level);
+      }
+      for (size_t i = 0; i < size; ++i) {
         if (num_channels_ == 1) {
-          out[0] = l * gain;
-          out[1] = l * gain;
+          out[2 * i] = l[i] * gain[i];
+          out[2 * i + 1] = l[i] * gain[i];
         } else if (num_channels_ == 2) {
-          float r = buffer[1].ReadHermite((position >> 12), position << 4);
-          out[0] = (l + (r - l) * swap_channels) * gain;
-          out[1] = (r + (l - r) * swap_channels) * gain;
+          out[2 * i] = (l[i] + (r[i] - l[i]) * swap_channels) * gain[i];
+          out[2 * i + 1] = (r[i] + (l[i] - r[i]) * swap_channels) * gain[i];
         }
-        
-        if (gain != 1.0f) {
-          gain = 1.0f - gain;
-          int32_t position = delay_int - static_cast<int32_t>(
-                (-phase_ + tail_start_) * 4096.0f);
-        
-          float l = buffer[0].ReadHermite((position >> 12), position << 4);
+      }
+
+      if (crossfade) {
+        buffer[0].ReadHermite(tail_position_, l, size, level);
+        if (num_channels_ == 2) {
+          buffer[1].ReadHermite(tail_position_, r, size, level);
+        }
+        for (size_t i = 0; i < size; ++i) {
+          if (gain[i] == 1.0f) {
+            continue;
+          }
+          float g = 1.0f - gain[i];
           if (num_channels_ == 1) {
-            out[0] += l * gain;
-            out[1] += l * gain;
+            out[2 * i] += l[i] * g;
+            out[2 * i + 1] += l[i] * g;
           } else if (num_channels_ == 2) {
-            float r = buffer[1].ReadHermite((position >> 12), position << 4);
-            out[0] += (l + (r - l) * swap_channels) * gain;
-            out[1] += (r + (l - r) * swap_channels) * gain;
+            out[2 * i] += (l[i] + (r[i] - l[i]) * swap_channels) * g;
+            out[2 * i + 1] += (r[i] + (l[i] - r[i]) * swap_channels) * g;
           }
         }
-        out += 2;
       }
     }
   }
@@ -229,6 +258,9 @@ class LoopingSamplePlayer {
   int32_t smoothed_tap_delay_;
   int32_t tap_delay_counter_;
 
+  int32_t position_[kMaxBlockSize];
+  int32_t tail_position_[kMaxBlockSize];
+
   DISALLOW_COPY_AND_ASSIGN(LoopingSamplePlayer);
 };
 
@@ -0,0 +1,153 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Block versions of the waveshapers used on the feedback and output paths.
+// They run on contiguous runs of interleaved samples, without per-sample
+// branches, so that the loops can be unrolled or vectorized by the compiler.
+
+#ifndef CLOUDS_DSP_NONLINEARITY_H_
+#define CLOUDS_DSP_NONLINEARITY_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+#include "stmlib/dsp/dsp.h"
+
+#include "supercell/resources.h"
+
+namespace clouds {
+
+// Reference (scalar) implementation of the distortion used by the spectral
+// clouds mode.
+inline float WarmDistortion(float smp, float parameter) {
+  if (parameter < 0.1f) {
+    return smp;
+  }
+  static const float kMaxDistf = 2.0f;
+  const float fac = kMaxDistf * parameter;
+  const float amp = 1.0f - parameter * 0.45f;
+
+  smp = (1.0f + fac) * smp - fac * smp * smp * smp;
+
+  float sign = 1.0f;
+  if (smp < 0) {
+    sign = -1.0;
+  }
+  float tanh_loopup = std::max(0.0f, std::min(1.0f, (smp / 2.0f) * sign));
+  float inv_tanh_smp = stmlib::Interpolate(lut_inv_tanh, tanh_loopup,
+      static_cast<float>(LUT_INV_TANH_SIZE - 1)) * sign;
+
+  smp = smp + (inv_tanh_smp - smp) * fac;
+  smp *= amp;
+  smp = std::max(-1.0f, std::min(1.0f, smp));
+  return smp;
+}
+
+// in_out[i] += amount * (SoftLimit(gain * x[i] + in_out[i]) - in_out[i])
+inline void SoftLimitMixBlock(
+    const float* x,
+    float gain,
+    float amount,
+    float* in_out,
+    size_t size) {
+  if (amount == 0.0f) {
+    return;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    const float s = gain * x[i] + in_out[i];
+    const float limited = s * (27.0f + s * s) / (27.0f + 9.0f * s * s);
+    in_out[i] += amount * (limited - in_out[i]);
+  }
+}
+
+// Same as stmlib::SoftConvert, clipping in the float domain rather than with
+// a branch on the converted integer.
+inline void SoftConvertBlock(const float* in, short* out, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    const float x = in[i] * 0.5f;
+    float s = x * (27.0f + x * x) / (27.0f + 9.0f * x * x) * 32768.0f;
+    s = s < -32768.0f ? -32768.0f : s;
+    s = s > 32767.0f ? 32767.0f : s;
+    out[i] = static_cast<short>(static_cast<int32_t>(s));
+  }
+}
+
+// Same, writing every stride-th sample of out.
+inline void SoftConvertBlock(
+    const float* in,
+    short* out,
+    size_t size,
+    size_t stride) {
+  for (size_t i = 0; i < size; ++i) {
+    const float x = in[i] * 0.5f;
+    float s = x * (27.0f + x * x) / (27.0f + 9.0f * x * x) * 32768.0f;
+    s = s < -32768.0f ? -32768.0f : s;
+    s = s > 32767.0f ? 32767.0f : s;
+    *out = static_cast<short>(static_cast<int32_t>(s));
+    out += stride;
+  }
+}
+
+// Block version of WarmDistortion. The sign is folded in with a select
+// and the table read is clamped on the index, so that no branch is left in
+// the loop.
+inline void WarmDistortionBlock(float* in_out, size_t size, float parameter) {
+  if (parameter < 0.1f) {
+    return;
+  }
+  const float fac = 2.0f * parameter;
+  const float amp = 1.0f - parameter * 0.45f;
+  const float table_size = static_cast<float>(LUT_INV_TANH_SIZE - 1);
+  for (size_t i = 0; i < size; ++i) {
+    float smp = in_out[i];
+    smp = (1.0f + fac) * smp - fac * smp * smp * smp;
+
+    float magnitude = smp < 0.0f ? -smp : smp;
+    float index = magnitude * 0.5f;
+    index = index > 1.0f ? 1.0f : index;
+    index *= table_size;
+    int32_t index_integral = static_cast<int32_t>(index);
+    index_integral = index_integral > LUT_INV_TANH_SIZE - 2
+        ? LUT_INV_TANH_SIZE - 2
+        : index_integral;
+    const float index_fractional = index - \
+        static_cast<float>(index_integral);
+    const float a = lut_inv_tanh[index_integral];
+    const float b = lut_inv_tanh[index_integral + 1];
+    float inv_tanh_smp = a + (b - a) * index_fractional;
+    inv_tanh_smp = smp < 0.0f ? -inv_tanh_smp : inv_tanh_smp;
+
+    smp = (smp + (inv_tanh_smp - smp) * fac) * amp;
+    smp = smp < -1.0f ? -1.0f : smp;
+    smp = smp > 1.0f ? 1.0f : smp;
+    in_out[i] = smp;
+  }
+}
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_NONLINEARITY_H_
@@ -0,0 +1,173 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Onset detector and coarse index of the onsets found in a recording buffer.
+//
+// The detector compares the energy of each block of samples written to the
+// buffer with the energy of the previous block. The index stores at most one
+// onset per bucket of (1 << shift_) samples of the buffer, so that finding
+// the onset closest to a given position in the buffer only requires looking
+// at two buckets.
+
+#ifndef CLOUDS_DSP_ONSET_INDEX_H_
+#define CLOUDS_DSP_ONSET_INDEX_H_
+
+#include <algorithm>
+
+#include "stmlib/stmlib.h"
+
+#include "stmlib/dsp/dsp.h"
+
+namespace clouds {
+
+const int32_t kOnsetIndexSize = 128;
+const int32_t kOnsetMinBucketShift = 6;
+const int32_t kOnsetHoldoff = 1024;
+const uint16_t kNoOnset = 0xffff;
+
+const float kOnsetFluxThreshold = 2.0f;
+const float kOnsetEnergyFloor = 1.0e-4f;
+
+class OnsetIndex {
+ public:
+  OnsetIndex() { }
+  ~OnsetIndex() { }
+
+  void Init(int32_t size) {
+    size_ = size;
+    shift_ = kOnsetMinBucketShift;
+    while (((size - 1) >> shift_) >= kOnsetIndexSize) {
+      ++shift_;
+    }
+    num_buckets_ = ((size - 1) >> shift_) + 1;
+    energy_ = 0.0f;
+    mean_energy_ = 0.0f;
+    Resync(0);
+  }
+
+  void Resync(int32_t head) {
+    std::fill(&onset_[0], &onset_[kOnsetIndexSize], kNoOnset);
+    head_ = head;
+    bucket_ = head >> shift_;
+    holdoff_ = 0;
+  }
+
+  // Analyzes a block of samples about to be written at the write head.
+  inline void Process(const float* in, int32_t size, int32_t stride) {
+    float energy = 0.0f;
+    for (int32_t i = 0; i < size; ++i) {
+      energy += *in * *in;
+      in += stride;
+    }
+    energy /= static_cast<float>(size);
+
+    float flux = energy - energy_;
+    energy_ = energy;
+    if (holdoff_ > 0) {
+      holdoff_ -= size;
+    } else if (flux > kOnsetFluxThreshold * mean_energy_ + kOnsetEnergyFloor) {
+      onset_[bucket_] = head_ & ((1 << shift_) - 1);
+      holdoff_ = kOnsetHoldoff;
+    }
+    ONE_POLE(mean_energy_, energy, 0.05f);
+
+    head_ += size;
+    if (head_ >= size_) {
+      head_ -= size_;
+    }
+
+    // The buckets the write head is moving into are about to be overwritten,
+    // their onsets are no longer valid.
+    int32_t bucket = head_ >> shift_;
+    while (bucket_ != bucket) {
+      ++bucket_;
+      if (bucket_ >= num_buckets_) {
+        bucket_ = 0;
+      }
+      onset_[bucket_] = kNoOnset;
+    }
+  }
+
+  // Returns the distance between position and the latest onset at or before
+  // it, or -1 if there is no such onset within max_distance samples. Onsets
+  // separated from position by the write head are ignored.
+  inline int32_t DistanceToOnset(int32_t position, int32_t max_distance) const {
+    while (position < 0) {
+      position += size_;
+    }
+    while (position >= size_) {
+      position -= size_;
+    }
+
+    int32_t bucket = position >> shift_;
+    int32_t offset = position & ((1 << shift_) - 1);
+    int32_t distance;
+    if (onset_[bucket] != kNoOnset && onset_[bucket] <= offset) {
+      distance = offset - onset_[bucket];
+    } else {
+      bucket = bucket == 0 ? num_buckets_ - 1 : bucket - 1;
+      if (onset_[bucket] == kNoOnset) {
+        return -1;
+      }
+      distance = position - ((bucket << shift_) + onset_[bucket]);
+      if (distance < 0) {
+        distance += size_;
+      }
+    }
+
+    int32_t distance_to_head = position - head_;
+    if (distance_to_head < 0) {
+      distance_to_head += size_;
+    }
+    if (distance > max_distance || distance_to_head < distance) {
+      return -1;
+    }
+    return distance;
+  }
+
+  inline int32_t bucket_size() const { return 1 << shift_; }
+
+ private:
+  int32_t size_;
+  int32_t shift_;
+  int32_t num_buckets_;
+
+  int32_t head_;
+  int32_t bucket_;
+  int32_t holdoff_;
+
+  float energy_;
+  float mean_energy_;
+
+  // Position of the onset, relative to the beginning of each bucket.
+  uint16_t onset_[kOnsetIndexSize];
+
+  DISALLOW_COPY_AND_ASSIGN(OnsetIndex);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_ONSET_INDEX_H_
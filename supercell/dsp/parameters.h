@@ -47,6 +47,8 @@ struct Parameters {
   bool freeze;
   bool trigger;
   bool gate;
+  bool snap_to_onsets;
+  bool skip_silent_slices;
   
   struct Granular {
     float overlap;
@@ -29,6 +29,7 @@
 #include "supercell/dsp/pvoc/frame_transformation.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "stmlib/dsp/atan.h"
 #include "stmlib/dsp/units.h"
@@ -56,6 +57,7 @@ void FrameTransformation::Init(
   phases_ = static_cast<uint16_t*>((void*)(textures_[num_textures - 1]));
   num_textures_ = num_textures - 1;  // Last texture is used for storing phases.
   phases_delta_ = phases_ + size_;
+  crossover_ = num_bins_ = size_;
 
   glitch_algorithm_ = 0;
   Reset();
@@ -67,6 +69,21 @@ void FrameTransformation::Reset() {
   }
 }
 
+void FrameTransformation::set_crossover(int32_t crossover) {
+  if (crossover <= 0 || crossover > size_) {
+    crossover = size_;
+  }
+  if (crossover == crossover_) {
+    return;
+  }
+  // The layout of the textures and phases changes: start again.
+  crossover_ = crossover;
+  int32_t num_bands = (size_ - crossover_ + kHighBandSize - 1) / kHighBandSize;
+  num_bins_ = crossover_ + num_bands;
+  fill(&phases_[0], &phases_[size_ * 2], 0);
+  Reset();
+}
+
 void FrameTransformation::Process(
     const Parameters& parameters,
     float* fft_out,
@@ -88,6 +105,7 @@ void FrameTransformation::Process(
   }
   float* temp = &fft_out[0];
   ReplayMagnitudes(ifft_in, parameters.position);
+  ExpandBands(ifft_in);
   WarpMagnitudes(ifft_in, temp, parameters.spectral.warp);
   ShiftMagnitudes(temp, ifft_in, pitch_ratio);
   if (glitch) {
@@ -111,11 +129,44 @@ void FrameTransformation::RectangularToPolar(float* fft_data) {
   float* real = &fft_data[0];
   float* imag = &fft_data[fft_size_ >> 1];
   float* magnitude = &fft_data[0];
-  for (int32_t i = 1; i < size_; ++i) {
+  for (int32_t i = 1; i < crossover_; ++i) {
     uint16_t angle = fast_atan2r(imag[i], real[i], &magnitude[i]);
     phases_delta_[i] = angle - phases_[i];
     phases_[i] = angle;
   }
+  
+  // Without rotation of the analysis frame, the phase of a stationary
+  // partial alternates by pi from one bin to the next. The bins of a band
+  // are summed with alternating signs to track its phase, and the band keeps
+  // their average energy.
+  int32_t bin = crossover_;
+  for (int32_t i = crossover_; i < num_bins_; ++i) {
+    int32_t end = min(bin + kHighBandSize, size_);
+    int32_t band_size = end - bin;
+    float re = 0.0f;
+    float im = 0.0f;
+    float energy = 0.0f;
+    for (int32_t j = 0; bin < end; ++bin, ++j) {
+      float sign = j & 1 ? -1.0f : 1.0f;
+      re += sign * real[bin];
+      im += sign * imag[bin];
+      energy += real[bin] * real[bin] + imag[bin] * imag[bin];
+    }
+    float unused;
+    uint16_t angle = fast_atan2r(im, re, &unused);
+    magnitude[i] = sqrtf(energy / static_cast<float>(band_size));
+    phases_delta_[i] = angle - phases_[i];
+    phases_[i] = angle;
+  }
+}
+
+void FrameTransformation::ExpandBands(float* xf_polar) {
+  // Backwards, since a band is never stored after its first bin.
+  for (int32_t i = num_bins_ - 1; i >= crossover_; --i) {
+    int32_t start = crossover_ + (i - crossover_) * kHighBandSize;
+    int32_t end = min(start + kHighBandSize, size_);
+    fill(&xf_polar[start], &xf_polar[end], xf_polar[i]);
+  }
 }
 
 void FrameTransformation::SetPhases(
@@ -123,7 +174,7 @@ void FrameTransformation::SetPhases(
     float phase_randomization,
     float pitch_ratio) {
   uint32_t* synthesis_phase = (uint32_t*) &destination[fft_size_ >> 1];
-  for (int32_t i = 0; i < size_; ++i) {
+  for (int32_t i = 0; i < num_bins_; ++i) {
     synthesis_phase[i] = phases_[i];
     phases_[i] += static_cast<uint16_t>(
         static_cast<float>(phases_delta_[i]) * pitch_ratio);
@@ -133,10 +184,21 @@ void FrameTransformation::SetPhases(
   CONSTRAIN(r, 0.0f, 1.0f);
   r *= r;
   int32_t amount = static_cast<int32_t>(r * 32768.0f);
-  for (int32_t i = 0; i < size_; ++i) {
+  for (int32_t i = 0; i < num_bins_; ++i) {
     synthesis_phase[i] += \
         static_cast<int32_t>(stmlib::Random::GetSample()) * amount >> 14;
   }
+  
+  // Spread the phase of each band over its bins, alternating by pi as they
+  // were analyzed.
+  for (int32_t i = num_bins_ - 1; i >= crossover_; --i) {
+    int32_t start = crossover_ + (i - crossover_) * kHighBandSize;
+    int32_t end = min(start + kHighBandSize, size_);
+    uint32_t phase = synthesis_phase[i];
+    for (int32_t j = start; j < end; ++j) {
+      synthesis_phase[j] = phase + ((j - start) & 1 ? 32768 : 0);
+    }
+  }
 }
 
 void FrameTransformation::PolarToRectangular(float* fft_data) {
@@ -316,7 +378,7 @@ void FrameTransformation::StoreMagnitudes(
     if (feedback < 0.5f) {
       gain_a *= 1.0f - feedback;
       gain_b *= 1.0f - feedback;
-      for (int32_t i = 0; i < size_; ++i) {
+      for (int32_t i = 0; i < num_bins_; ++i) {
         float x = *xf_polar++;
         a[i] = Crossfade(a[i], x, gain_a);
         b[i] = Crossfade(b[i], x, gain_b);
@@ -329,7 +391,7 @@ void FrameTransformation::StoreMagnitudes(
       float gain_new_b = gain_b * gain_new;
       float gain_old_a = 1.0f - gain_a * (1.0f - t);
       float gain_old_b = 1.0f - gain_b * (1.0f - t);
-      for (int32_t i = 0; i < size_; ++i) {
+      for (int32_t i = 0; i < num_bins_; ++i) {
         float x = *xf_polar++;
         a[i] = a[i] * gain_old_a + x * gain_new_a;
         b[i] = b[i] * gain_old_b + x * gain_new_b;
@@ -339,7 +401,7 @@ void FrameTransformation::StoreMagnitudes(
     feedback *= 2.0f;
     feedback *= feedback;
     uint16_t threshold = feedback * 65535.0f;
-    for (int32_t i = 0; i < size_; ++i) {
+    for (int32_t i = 0; i < num_bins_; ++i) {
       float x = *xf_polar++;
       float gain = static_cast<uint16_t>(Random::GetSample()) <= threshold
           ? 1.0f : 0.0f;
@@ -355,7 +417,7 @@ void FrameTransformation::ReplayMagnitudes(float* xf_polar, float position) {
   float index_fractional = index_float - static_cast<float>(index_int);
   float* a = textures_[index_int];
   float* b = textures_[index_int + (position == 1.0f ? 0 : 1)];
-  for (int32_t i = 0; i < size_; ++i) {
+  for (int32_t i = 0; i < num_bins_; ++i) {
     xf_polar[i] = Crossfade(a[i], b[i], index_fractional);
   }
 }
@@ -46,6 +46,9 @@ class FrameTransformation : public Modifier {
 
   static const int32_t kMaxNumTextures = 7;
   static const int32_t kHighFrequencyTruncation = 16;
+  
+  // Width, in bins, of the bands above the crossover.
+  static const int32_t kHighBandSize = 4;
 
   virtual uint32_t num_textures() const {
     return kMaxNumTextures;
@@ -59,6 +62,12 @@ class FrameTransformation : public Modifier {
             float sample_rate_hz, FFT* fft);
   void Reset();
   
+  // Above the crossover bin, bins are processed in bands of kHighBandSize
+  // sharing the same magnitude and phase advance. The bands are much
+  // narrower than the ear's resolution in the upper octaves, but save most
+  // of the per-bin work there. 0 processes all bins individually.
+  void set_crossover(int32_t crossover);
+  
   virtual void Process(
       const Parameters& parameters,
       float* fft_out,
@@ -67,6 +76,7 @@ class FrameTransformation : public Modifier {
   
  private:
   void RectangularToPolar(float* fft_data);
+  void ExpandBands(float* xf_polar);
   void PolarToRectangular(float* fft_data);
   void AddGlitch(float* xf_polar);
   void ShiftMagnitudes(
@@ -93,6 +103,11 @@ class FrameTransformation : public Modifier {
   int32_t num_textures_;
   int32_t size_;
   
+  // First bin processed in bands, and number of bins and bands stored in the
+  // textures.
+  int32_t crossover_;
+  int32_t num_bins_;
+  
   // Magnitude buffers.
   float* textures_[kMaxNumTextures];
   
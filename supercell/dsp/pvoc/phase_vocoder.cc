@@ -57,6 +57,8 @@ void PhaseVocoder::Init() {
 
   new(&spectral_clouds_transformation_[0]) SpectralCloudsTransformation();
   new(&spectral_clouds_transformation_[1]) SpectralCloudsTransformation();
+  
+  crossover_ = 0;
 }
 
 void PhaseVocoder::Init(
@@ -69,6 +71,7 @@ void PhaseVocoder::Init(
     int32_t resolution,
     float sample_rate) {
   num_channels_ = num_channels;
+  transformation_type_ = transformation_type;
 
   size_t fft_size = largest_fft_size;
   size_t hop_ratio = 4;
@@ -133,6 +136,11 @@ void PhaseVocoder::Process(
 }
 
 void PhaseVocoder::Buffer() {
+  if (transformation_type_ == TRANSFORMATION_TYPE_FRAME) {
+    for (int32_t i = 0; i < num_channels_; ++i) {
+      frame_transformation_[i].set_crossover(crossover_);
+    }
+  }
   for (int32_t i = 0; i < num_channels_; ++i) {
     stft_[i].Buffer();
   }
@@ -31,6 +31,8 @@
 
 #include "stmlib/stmlib.h"
 
+#include <algorithm>
+
 #include "stmlib/fft/shy_fft.h"
 
 #include "supercell/dsp/frame.h"
@@ -69,6 +71,25 @@ class PhaseVocoder {
       size_t size);
   void Buffer();
   
+  // First FFT bin processed in bands by the frame transformation, or 0.
+  // Takes effect on the next call to Buffer().
+  inline void set_crossover(int32_t crossover) {
+    crossover_ = crossover;
+  }
+  
+  // Frames ready in the STFTs and not processed yet by Buffer().
+  inline size_t backlog() const {
+    size_t backlog = 0;
+    for (int32_t i = 0; i < num_channels_; ++i) {
+      backlog = std::max(backlog, stft_[i].backlog());
+    }
+    return backlog;
+  }
+  
+  inline const STFT& stft(int32_t channel) const {
+    return stft_[channel];
+  }
+  
  private:
   FFT fft_;
   
@@ -76,7 +97,9 @@ class PhaseVocoder {
   FrameTransformation frame_transformation_[2];
   SpectralCloudsTransformation spectral_clouds_transformation_[2];
 
+  TransformationType transformation_type_;
   int32_t num_channels_;
+  int32_t crossover_;
 
   DISALLOW_COPY_AND_ASSIGN(PhaseVocoder);
 };
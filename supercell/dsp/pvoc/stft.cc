@@ -77,6 +77,10 @@ void STFT::Init(
   parameters_ = NULL;
   
   trigger_received_ = false;
+  
+  max_backlog_ = 0;
+  num_processed_frames_ = 0;
+  num_dropped_frames_ = 0;
 
   Reset();
 }
@@ -123,11 +127,45 @@ void STFT::Process(
   }
 }
 
+void STFT::DropFrame() {
+  // This frame would have started a new slot in the synthesis buffer. Clear it
+  // instead, so that the next frames are overlap-added to silence rather than
+  // to a stale block of output.
+  size_t destination_ptr = process_ptr_ + fft_size_ - hop_size_;
+  for (size_t i = 0; i < hop_size_; ++i) {
+    if (destination_ptr >= buffer_size_) {
+      destination_ptr -= buffer_size_;
+    }
+    synthesis_[destination_ptr] = 0;
+    ++destination_ptr;
+  }
+
+  ++done_;
+  ++num_dropped_frames_;
+  process_ptr_ += hop_size_;
+  if (process_ptr_ >= buffer_size_) {
+    process_ptr_ -= buffer_size_;
+  }
+}
+
 void STFT::Buffer() {
-  if (ready_ == done_) {
+  size_t backlog = ready_ - done_;
+  if (!backlog) {
     return;
   }
   
+  if (backlog > max_backlog_) {
+    max_backlog_ = backlog;
+  }
+  
+  // The analysis window of the oldest frames has already been overwritten.
+  // Skip them and process the most recent frame.
+  if (backlog > kMaxFrameBacklog) {
+    while (--backlog) {
+      DropFrame();
+    }
+  }
+  
   // Copy block to FFT buffer and apply window.
   size_t source_ptr = process_ptr_;
   const float* w = window_;
@@ -208,6 +246,7 @@ void STFT::Buffer() {
   }
 
   ++done_;
+  ++num_processed_frames_;
   process_ptr_ += hop_size_;
   if (process_ptr_ >= buffer_size_) {
     process_ptr_ -= buffer_size_;
@@ -45,6 +45,14 @@ struct Parameters;
 class Modifier;
 
 const size_t kMaxFftSize = 4096;
+
+// Frame n windows the fft_size samples ending with hop n. The analysis buffer
+// holds fft_size + hop_size samples, one hop more than a window, so the frame
+// is only overwritten once hop n + 2 starts being written: with a backlog of 2
+// it is still whole when Buffer() runs on a hop boundary. With a backlog of 3,
+// a full hop at the start of the window has been overwritten, so the frame is
+// dropped.
+const size_t kMaxFrameBacklog = 2;
 #ifdef USE_ARM_FFT
   typedef arm_rfft_fast_instance_f32 FFT;
 #else
@@ -78,8 +86,15 @@ class STFT {
       size_t stride);
 
   void Buffer();
+
+  inline size_t backlog() const { return ready_ - done_; }
+  inline size_t max_backlog() const { return max_backlog_; }
+  inline uint32_t num_processed_frames() const { return num_processed_frames_; }
+  inline uint32_t num_dropped_frames() const { return num_dropped_frames_; }
   
  private:
+  void DropFrame();
+
   FFT* fft_;
   size_t fft_size_;
   size_t fft_num_passes_;
@@ -100,9 +115,13 @@ class STFT {
   size_t process_ptr_;
   size_t block_size_;
   
-  size_t ready_;
+  volatile size_t ready_;
   size_t done_;
   
+  size_t max_backlog_;
+  uint32_t num_processed_frames_;
+  uint32_t num_dropped_frames_;
+  
   const Parameters* parameters_;
   
   Modifier* modifier_;
@@ -141,16 +141,6 @@ class Resonestor {
     E::DelayLine<Memory, 10> c31;
     E::Context c;
 
-    /* switch active voice */
-    if (trigger_ && !previous_trigger_ && !freeze_) {
-      voice_ = !voice_;
-    }
-
-    if (freeze_ && !previous_freeze_) {
-      previous_freeze_ = freeze_;
-      voice_ = !voice_;
-    }
-
     /* set comb filters pitch */
     comb_period_[0][voice_] = 32000.0f / BASE_PITCH / SemitonesToRatio(pitch_[voice_]);
     CONSTRAIN(comb_period_[0][voice_], 0, MAX_COMB);
@@ -311,9 +301,14 @@ class Resonestor {
     distortion_[voice_] = distortion;
   }
 
+  // The active voice is switched by set_freeze() and set_trigger(), which
+  // must be called first: the settings which follow go to the new voice.
   void set_trigger(bool trigger) {
     previous_trigger_ = trigger_;
     trigger_ = trigger;
+    if (trigger_ && !previous_trigger_ && !freeze_) {
+      voice_ = !voice_;
+    }
   }
 
   void set_burst_damp(float burst_damp) {
@@ -343,6 +338,9 @@ class Resonestor {
   void set_freeze(float freeze) {
     previous_freeze_ = freeze_;
     freeze_ = freeze;
+    if (freeze_ && !previous_freeze_) {
+      voice_ = !voice_;
+    }
   }
 
   void set_harmonicity(float harmonicity) {
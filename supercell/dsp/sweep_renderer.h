@@ -0,0 +1,163 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Renders the same input through several variants of the parameters, for
+// preset design on the host. The input is recorded only once: the variants
+// which would record exactly the same signal play from the buffers of the
+// first of them, and only run their players and effects. The others (with
+// feedback, or in modes without recording buffers) process the input on
+// their own.
+
+#ifndef CLOUDS_DSP_SWEEP_RENDERER_H_
+#define CLOUDS_DSP_SWEEP_RENDERER_H_
+
+#include "stmlib/stmlib.h"
+
+#include <cstdlib>
+
+#include "supercell/dsp/granular_processor.h"
+
+namespace clouds {
+
+const size_t kSweepLargeBufferSize = 118784;
+const size_t kSweepSmallBufferSize = 65536 - 128;
+const size_t kSweepMemorySize = kSweepLargeBufferSize + kSweepSmallBufferSize;
+
+class SweepRenderer {
+ public:
+  SweepRenderer() { }
+  ~SweepRenderer() { }
+
+  void Init(
+      PlaybackMode playback_mode,
+      int32_t quality,
+      const Parameters* parameters,
+      size_t num_variants) {
+    num_variants_ = num_variants;
+    num_shared_ = 0;
+    // On the module, the processor is a static object: Init() does not
+    // reset the state which starts at zero.
+    void* processors = calloc(num_variants, sizeof(GranularProcessor));
+    processor_ = static_cast<GranularProcessor*>(processors);
+    for (size_t i = 0; i < num_variants; ++i) {
+      new(&processor_[i]) GranularProcessor();
+    }
+    memory_ = static_cast<uint8_t*>(calloc(num_variants, kSweepMemorySize));
+
+    GranularProcessor* source = NULL;
+    const Parameters* source_parameters = NULL;
+    for (size_t i = 0; i < num_variants; ++i) {
+      uint8_t* memory = &memory_[i * kSweepMemorySize];
+      processor_[i].Init(
+          memory, kSweepLargeBufferSize,
+          memory + kSweepLargeBufferSize, kSweepSmallBufferSize);
+      processor_[i].set_quality(quality);
+      processor_[i].set_playback_mode(playback_mode);
+      *processor_[i].mutable_parameters() = parameters[i];
+      if (!SharesRecording(playback_mode, parameters[i])) {
+        continue;
+      }
+      if (!source) {
+        source = &processor_[i];
+        source_parameters = &parameters[i];
+      } else if (SameMixdown(
+          playback_mode, quality, parameters[i], *source_parameters)) {
+        processor_[i].set_recording_source(source);
+        ++num_shared_;
+      }
+    }
+    for (size_t i = 0; i < num_variants; ++i) {
+      processor_[i].Prepare();
+    }
+  }
+
+  void Done() {
+    free(processor_);
+    free(memory_);
+    processor_ = NULL;
+    memory_ = NULL;
+    num_variants_ = 0;
+  }
+
+  // Renders size frames of input into the output buffer of each variant.
+  // The processor recording the shared input comes before those playing it.
+  void Process(const ShortFrame* input, ShortFrame** output, size_t size) {
+    for (size_t i = 0; i < num_variants_; ++i) {
+      processor_[i].Process(&input[0].l, &output[i][0].l, size, 1);
+    }
+    for (size_t i = 0; i < num_variants_; ++i) {
+      processor_[i].Prepare();
+    }
+  }
+
+  inline GranularProcessor* mutable_processor(size_t variant) {
+    return &processor_[variant];
+  }
+
+  // Number of variants playing from the recording of another one.
+  inline size_t num_shared() const { return num_shared_; }
+
+ private:
+  // Whether the variant records the input as it is, in one of the modes
+  // playing from the recording buffers.
+  static bool SharesRecording(
+      PlaybackMode playback_mode,
+      const Parameters& parameters) {
+    if (playback_mode == PLAYBACK_MODE_SPECTRAL ||
+        playback_mode == PLAYBACK_MODE_SPECTRAL_CLOUD ||
+        playback_mode == PLAYBACK_MODE_RESONESTOR) {
+      return false;
+    }
+    // REVERB is the amount of feedback of the slices in Kammerl mode.
+    bool feedback = parameters.feedback != 0.0f ||
+        (playback_mode == PLAYBACK_MODE_KAMMERL && parameters.reverb != 0.0f);
+    return !feedback && !parameters.freeze;
+  }
+
+  // In mono, STEREO SPREAD crossfades between the inputs in the looping
+  // delay and stretch modes, so it must match to record the same signal.
+  static bool SameMixdown(
+      PlaybackMode playback_mode,
+      int32_t quality,
+      const Parameters& a,
+      const Parameters& b) {
+    bool crossfade = (quality & 1) && (
+        playback_mode == PLAYBACK_MODE_LOOPING_DELAY ||
+        playback_mode == PLAYBACK_MODE_STRETCH);
+    return !crossfade || a.stereo_spread == b.stereo_spread;
+  }
+
+  size_t num_variants_;
+  size_t num_shared_;
+  GranularProcessor* processor_;
+  uint8_t* memory_;
+
+  DISALLOW_COPY_AND_ASSIGN(SweepRenderer);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_SWEEP_RENDERER_H_
@@ -0,0 +1,160 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Small pool of threads running the same job on several workers, used on the
+// host to spread the rendering of a block over several cores. The calling
+// thread acts as worker 0, and Run() returns once all workers are done.
+
+#ifndef CLOUDS_DSP_WORKER_POOL_H_
+#define CLOUDS_DSP_WORKER_POOL_H_
+
+#include <pthread.h>
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+const int32_t kMaxNumWorkers = 8;
+
+class WorkerPool {
+ public:
+  typedef void (*Job)(void* context, int32_t worker);
+
+  WorkerPool() { }
+  ~WorkerPool() { }
+  
+  void Init(int32_t num_workers) {
+    CONSTRAIN(num_workers, 1, kMaxNumWorkers);
+    num_workers_ = num_workers;
+    generation_ = 0;
+    pending_ = 0;
+    quit_ = false;
+    job_ = NULL;
+    context_ = NULL;
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&start_, NULL);
+    pthread_cond_init(&done_, NULL);
+    for (int32_t i = 1; i < num_workers_; ++i) {
+      workers_[i].pool = this;
+      workers_[i].index = i;
+      pthread_create(&threads_[i], NULL, &WorkerPool::Main, &workers_[i]);
+    }
+  }
+  
+  void Done() {
+    pthread_mutex_lock(&mutex_);
+    quit_ = true;
+    pthread_cond_broadcast(&start_);
+    pthread_mutex_unlock(&mutex_);
+    for (int32_t i = 1; i < num_workers_; ++i) {
+      pthread_join(threads_[i], NULL);
+    }
+    pthread_cond_destroy(&done_);
+    pthread_cond_destroy(&start_);
+    pthread_mutex_destroy(&mutex_);
+    num_workers_ = 1;
+  }
+  
+  void Run(Job job, void* context) {
+    if (num_workers_ == 1) {
+      job(context, 0);
+      return;
+    }
+    pthread_mutex_lock(&mutex_);
+    job_ = job;
+    context_ = context;
+    pending_ = num_workers_ - 1;
+    ++generation_;
+    pthread_cond_broadcast(&start_);
+    pthread_mutex_unlock(&mutex_);
+    
+    job(context, 0);
+    
+    pthread_mutex_lock(&mutex_);
+    while (pending_) {
+      pthread_cond_wait(&done_, &mutex_);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+  
+  inline int32_t num_workers() const { return num_workers_; }
+  
+ private:
+  struct Worker {
+    WorkerPool* pool;
+    int32_t index;
+  };
+  
+  static void* Main(void* arg) {
+    Worker* worker = static_cast<Worker*>(arg);
+    worker->pool->Loop(worker->index);
+    return NULL;
+  }
+  
+  void Loop(int32_t index) {
+    uint32_t generation = 0;
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+      while (generation == generation_ && !quit_) {
+        pthread_cond_wait(&start_, &mutex_);
+      }
+      if (quit_) {
+        break;
+      }
+      generation = generation_;
+      Job job = job_;
+      void* context = context_;
+      pthread_mutex_unlock(&mutex_);
+      
+      job(context, index);
+      
+      pthread_mutex_lock(&mutex_);
+      if (--pending_ == 0) {
+        pthread_cond_signal(&done_);
+      }
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+  
+  int32_t num_workers_;
+  uint32_t generation_;
+  int32_t pending_;
+  bool quit_;
+  Job job_;
+  void* context_;
+  
+  pthread_mutex_t mutex_;
+  pthread_cond_t start_;
+  pthread_cond_t done_;
+  pthread_t threads_[kMaxNumWorkers];
+  Worker workers_[kMaxNumWorkers];
+  
+  DISALLOW_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_WORKER_POOL_H_
@@ -83,6 +83,20 @@ class WSOLASamplePlayer {
     synchronized_ = false;
   }
   
+  // Called at the start of each control block, before Play(), so that the
+  // rendering does not depend on the size of the blocks passed to Play().
+  void UpdateControls(const Parameters& parameters) {
+    env_phase_ += env_phase_increment_;
+    if (env_phase_ >= 1.0f) {
+      env_phase_ = 1.0;
+    }
+    position_ = parameters.position;
+    position_ += (1.0f - env_phase_) * (1.0f - position_);
+
+    pitch_ = parameters.pitch;
+    size_factor_ = parameters.size;
+  }
+  
   template<Resolution resolution>
   void Play(
       const AudioBuffer<resolution>* buffer,
@@ -105,19 +119,12 @@ class WSOLASamplePlayer {
       tap_delay_counter_ = 0;
     }
 
-    env_phase_ += env_phase_increment_;
-    if (env_phase_ >= 1.0f) {
-      env_phase_ = 1.0;
-    }
-    position_ = parameters.position;
-    position_ += (1.0f - env_phase_) * (1.0f - position_);
-
-    pitch_ = parameters.pitch;
-    size_factor_ = parameters.size;
-    
+    // The windows are positioned relative to the sample being rendered,
+    // not to the end of the block.
+    int32_t head = buffer->head() - static_cast<int32_t>(size);
     if (windows_[0].done() && windows_[1].done()) {
       windows_[1].MarkAsRegenerated();
-      ScheduleAlignedWindow(buffer, &windows_[0]);
+      ScheduleAlignedWindow(buffer, head, &windows_[0]);
     }
 
     const float swap_channels = parameters.stereo_spread;
@@ -133,11 +140,12 @@ class WSOLASamplePlayer {
       for (int32_t i = 0; i < 2; ++i) {
         if (windows_[i].needs_regeneration()) {
           windows_[i].MarkAsRegenerated();
-          ScheduleAlignedWindow(buffer, &windows_[1 - i]);
+          ScheduleAlignedWindow(buffer, head, &windows_[1 - i]);
           windows_[1 - i].OverlapAdd(buffer, out, num_channels_, swap_channels);
         }
       }
       out += 2;
+      ++head;
     }
   }
   
@@ -234,6 +242,7 @@ class WSOLASamplePlayer {
   template<Resolution resolution>
   void ScheduleAlignedWindow(
       const AudioBuffer<resolution>* buffer,
+      int32_t head,
       Window* window) {
     int32_t next_window_position = correlator_->best_match();
     correlator_loaded_ = false;
@@ -283,7 +292,7 @@ class WSOLASamplePlayer {
       if (position < 0) position = 0;
     }
 
-    int32_t target_position = buffer->head();
+    int32_t target_position = head;
     target_position -= static_cast<int32_t>(position);
     target_position -= window_size_;
 
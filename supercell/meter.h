@@ -47,24 +47,24 @@ class Meter {
     peak_r_ = 0;
   }
 
-  void Process(Codec::Frame* frames, size_t size) {
+  void Process(const short* samples, size_t size, size_t stride) {
     while (size--) {
       int32_t sample;
       int32_t error;
       int32_t coefficient;
 
-      sample = frames->l;
+      sample = samples[0];
       if (sample < 0) sample = -sample;
       error = sample - peak_l_;
       coefficient = error > 0 ? attack_ : release_;
       peak_l_ += error * coefficient >> 15;
 
-      sample = frames->r;
+      sample = samples[stride];
       if (sample < 0) sample = -sample;
       error = sample - peak_r_;
       coefficient = error > 0 ? attack_ : release_;
       peak_r_ += error * coefficient >> 15;
-      ++frames;
+      samples += 2 * stride;
     }
   }
 
@@ -105,6 +105,10 @@ const float src_filter_1x_2_91[] = {
   -1.567613822e-04, -1.086251194e-04,  5.995404419e-05,
 };
 
+const float src_filter_iir_2_4[] = {
+   1.207321175e-01,  3.903621872e-01,  6.632020224e-01,  8.907868327e-01,
+};
+
 
 
 const float* src_filter_table[] = {
@@ -112,6 +116,7 @@ const float* src_filter_table[] = {
   src_filter_1x_2_45,
   src_filter_1x_2_63,
   src_filter_1x_2_91,
+  src_filter_iir_2_4,
 };
 
 const int16_t lut_db[] = {
@@ -52,6 +52,7 @@ extern const float src_filter_1x_2_31[];
 extern const float src_filter_1x_2_45[];
 extern const float src_filter_1x_2_63[];
 extern const float src_filter_1x_2_91[];
+extern const float src_filter_iir_2_4[];
 extern const int16_t lut_db[];
 extern const float lut_freq_log[];
 extern const float lut_inv_tanh[];
@@ -72,6 +73,8 @@ extern const float lut_quantized_pitch[];
 #define SRC_FILTER_1X_2_63_SIZE 63
 #define SRC_FILTER_1X_2_91 3
 #define SRC_FILTER_1X_2_91_SIZE 91
+#define SRC_FILTER_IIR_2_4 4
+#define SRC_FILTER_IIR_2_4_SIZE 4
 #define LUT_DB 0
 #define LUT_DB_SIZE 257
 #define LUT_FREQ_LOG 0
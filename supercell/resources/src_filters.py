@@ -81,3 +81,40 @@ for oversampled, ratio, length in configurations:
     pylab.savefig(name + '.pdf')
     pylab.close()
   filters += [(name, ir)]
+
+# Half-band filters made of two parallel chains of first order allpass
+# sections in z^-2, for the polyphase IIR converters. The coefficients are
+# those of an elliptic half-band filter (Valenzuela & Constantinides), with
+# the same passband edge (0.2 fs) as the FIR filters above.
+iir_lengths = [4]
+iir_transition = 0.05
+
+def iir_transition_parameters(transition):
+  k = numpy.tan((1 - transition * 2) * numpy.pi / 4) ** 2
+  k_sqrt = (1 - k * k) ** 0.25
+  e = 0.5 * (1 - k_sqrt) / (1 + k_sqrt)
+  e4 = e ** 4
+  q = e * (1 + e4 * (2 + e4 * (15 + 150 * e4)))
+  return k, q
+
+
+def iir_coefficient(index, k, q, order):
+  c = index + 1
+  num = 0.0
+  den = 0.0
+  for i in xrange(0, 20):
+    num += (-1) ** i * q ** (i * (i + 1)) * \
+        numpy.sin((i * 2 + 1) * c * numpy.pi / order)
+  for i in xrange(1, 20):
+    den += (-1) ** i * q ** (i * i) * numpy.cos(i * 2 * c * numpy.pi / order)
+  ww = num * q ** 0.25 / (den + 0.5)
+  ww *= ww
+  x = numpy.sqrt((1 - ww * k) * (1 - ww / k)) / (1 + ww)
+  return (1 - x) / (1 + x)
+
+
+for length in iir_lengths:
+  k, q = iir_transition_parameters(iir_transition)
+  order = length * 2 + 1
+  coefficients = [iir_coefficient(i, k, q, order) for i in xrange(length)]
+  filters += [('filter_iir_2_%d' % length, numpy.array(coefficients))]
@@ -69,7 +69,7 @@ class Settings {
   }
 
   inline uint32_t* mutable_sample_flash_data(uint32_t index) const {
-    return (uint32_t*)(0x08080000 + index * 0x0020000);
+    return (uint32_t*)(uintptr_t)(0x08080000 + index * 0x0020000);
   }
 
   inline uint32_t sample_flash_sector(uint32_t index) {
@@ -39,6 +39,14 @@
 using namespace clouds;
 using namespace stmlib;
 
+#ifndef AUDIO_BLOCK_SIZE
+#define AUDIO_BLOCK_SIZE 32
+#endif  // AUDIO_BLOCK_SIZE
+
+// Codec block size. With 8 or 16 samples, the round-trip latency drops to
+// 0.5 or 1ms, while the control-rate processing still runs at 1kHz.
+const size_t kAudioBlockSize = AUDIO_BLOCK_SIZE;
+
 GranularProcessor processor;
 Codec codec;
 DebugPort debug_port;
@@ -74,6 +82,9 @@ void __cxa_pure_virtual() { while (1); }
 extern "C" {
 
 void SysTick_Handler() {
+  // Control-rate processing. The audio interrupt preempts this and only
+  // picks up the last set of parameters published by the CV scaler.
+  cv_scaler.Scan();
   ui.Poll();
   if (settings.freshly_baked()) {
     if (debug_port.readable()) {
@@ -86,14 +97,14 @@ void SysTick_Handler() {
 
 }
 
-void FillBuffer(Codec::Frame* input, Codec::Frame* output, size_t n) {
+void FillBuffer(short* input, short* output, size_t n, size_t stride) {
 #ifdef PROFILE_INTERRUPT
   TIC
 #endif  // PROFILE_INTERRUPT
   cv_scaler.Read(processor.mutable_parameters());
-  in_meter.Process(input, n); // Process input meter before processing (avoids mutes, etc.)
-  processor.Process((ShortFrame*)input, (ShortFrame*)output, n);
-  out_meter.Process(output, n);
+  in_meter.Process(input, n, stride); // Process input meter before processing (avoids mutes, etc.)
+  processor.Process(input, output, n, stride);
+  out_meter.Process(output, n, stride);
 #ifdef PROFILE_INTERRUPT
   TOC
 #endif  // PROFILE_INTERRUPT
@@ -121,7 +132,7 @@ void Init() {
   if (!codec.Init(master, 32000)) {
     ui.Panic();
   }
-  if (!codec.Start(32, &FillBuffer)) {
+  if (!codec.Start(kAudioBlockSize, &FillBuffer)) {
     ui.Panic();
   }
   if (settings.freshly_baked()) {
@@ -27,12 +27,26 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <xmmintrin.h>
 
+#include "supercell/bootloader/flash_writer.h"
+#include "supercell/bootloader/lz_decoder.h"
+#include "supercell/bootloader/test/simulated_flash.h"
+#include "supercell/bootloader/update_receiver.h"
+#include "supercell/cv_mapper.h"
+#include "supercell/dsp/frame.h"
+#include "supercell/dsp/fx/pitch_shifter.h"
+#include "supercell/dsp/fx/reverb.h"
+#include "supercell/dsp/fx/reverb_bank.h"
 #include "supercell/dsp/granular_processor.h"
+#include "supercell/dsp/kernels.h"
+#include "supercell/dsp/nonlinearity.h"
+#include "supercell/dsp/pvoc/stft.h"
+#include "supercell/dsp/sweep_renderer.h"
 #include "supercell/resources.h"
 
 using namespace clouds;
@@ -154,8 +168,1546 @@ void TestDSP() {
   fclose(fp_in);
 }
 
+void TestNonlinearities() {
+  const size_t kSize = 4096;
+  vector<float> x(kSize);
+  vector<float> y(kSize);
+  vector<short> converted(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    x[i] = 8.0f * (static_cast<float>(i) / kSize - 0.5f);
+  }
+
+  SoftConvertBlock(&x[0], &converted[0], kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    assert(converted[i] == SoftConvert(x[i]));
+  }
+
+  const float gain = 1.4f * 0.7f;
+  copy(x.begin(), x.end(), y.begin());
+  SoftLimitMixBlock(&x[0], gain, 0.7f, &y[0], kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    float expected = x[i] + 0.7f * (SoftLimit(gain * x[i] + x[i]) - x[i]);
+    assert(fabs(y[i] - expected) < 1e-5f);
+  }
+
+  for (float parameter = 0.0f; parameter <= 1.0f; parameter += 0.05f) {
+    copy(x.begin(), x.end(), y.begin());
+    WarmDistortionBlock(&y[0], kSize, parameter);
+    for (size_t i = 0; i < kSize; ++i) {
+      assert(fabs(y[i] - WarmDistortion(x[i], parameter)) < 1e-5f);
+    }
+  }
+}
+
+void TestKernels() {
+  // Sizes which are not multiples of the vector sizes go through the scalar
+  // code for the remaining samples.
+  const size_t kSize = 4096 + 13;
+  vector<float> x(kSize);
+  vector<float> y(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    x[i] = 8.0f * (Random::GetFloat() - 0.5f);
+    y[i] = 2.0f * (Random::GetFloat() - 0.5f);
+  }
+
+  vector<float> mixed[KERNEL_SET_LAST];
+  vector<short> converted[KERNEL_SET_LAST];
+  for (int32_t i = 0; i < KERNEL_SET_LAST; ++i) {
+    KernelSet set = static_cast<KernelSet>(i);
+    const Kernels& kernels = GetKernels(set);
+    if (!KernelSetSupported(set)) {
+      continue;
+    }
+    mixed[i] = y;
+    converted[i].resize(kSize);
+    kernels.soft_limit_mix(&x[0], 1.4f * 0.7f, 0.7f, &mixed[i][0], kSize);
+    kernels.soft_convert(&x[0], &converted[i][0], kSize);
+    assert(mixed[i] == mixed[0]);
+    assert(converted[i] == converted[0]);
+  }
+  assert(KernelSetSupported(KERNEL_SET_SCALAR));
+  assert(KernelSetSupported(BestKernelSet()));
+}
+
+void TestOnsetIndex() {
+  const int32_t kBufferSize = 8192;
+  vector<int16_t> memory(kBufferSize + kInterpolationTail);
+  vector<int16_t> tail(kCrossFadeSize);
+  AudioBuffer<RESOLUTION_16_BIT> buffer;
+  buffer.Init(&memory[0], memory.size(), &tail[0]);
+
+  // A burst starting at 1600 samples, in the middle of 64 blocks of silence.
+  float block[kBlockSize];
+  for (int32_t i = 0; i < 64; ++i) {
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      block[j] = i >= 50 && i < 55 ? (j & 1 ? 0.5f : -0.5f) : 0.0f;
+    }
+    buffer.Write(block, kBlockSize, 1);
+    if (buffer.head() == 1664) {
+      assert(buffer.onsets().DistanceToOnset(1650, 1000) == 50);
+      // Separated from the onset by the write head.
+      assert(buffer.onsets().DistanceToOnset(1670, 1000) == -1);
+    }
+  }
+  const OnsetIndex& onsets = buffer.onsets();
+  assert(onsets.DistanceToOnset(1700, 1000) == 100);
+  assert(onsets.DistanceToOnset(1700, 50) == -1);
+  assert(onsets.DistanceToOnset(1500, 1000) == -1);
+
+  // Once the burst has been overwritten, it is no longer indexed.
+  fill(&block[0], &block[kBlockSize], 0.0f);
+  for (int32_t i = 0; i < kBufferSize / int32_t(kBlockSize); ++i) {
+    buffer.Write(block, kBlockSize, 1);
+  }
+  assert(onsets.DistanceToOnset(1700, 1000) == -1);
+}
+
+void TestChunkIndex() {
+  const int32_t kBufferSize = 8192;
+  vector<int16_t> memory(kBufferSize + kInterpolationTail);
+  vector<int16_t> tail(kCrossFadeSize);
+  AudioBuffer<RESOLUTION_16_BIT> buffer;
+  buffer.Init(&memory[0], memory.size(), &tail[0]);
+  const ChunkIndex& chunks = buffer.chunks();
+  assert(chunks.chunk_size() == 256);
+  assert(chunks.num_chunks() == 32);
+
+  // A square wave between 1024 and 1536 samples, silence elsewhere.
+  float block[kBlockSize];
+  for (int32_t i = 0; i < 64; ++i) {
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      block[j] = i >= 32 && i < 48 ? (j & 1 ? 0.5f : -0.25f) : 0.0f;
+    }
+    buffer.Write(block, kBlockSize, 1);
+  }
+  assert(chunks.valid(4) && chunks.valid(5) && chunks.valid(7));
+  assert(chunks.peak(3) == 0.0f && chunks.rms(3) == 0.0f);
+  assert(fabs(chunks.peak(4) - 0.5f) < 1e-4f);
+  assert(fabs(chunks.rms(5) - sqrtf(0.15625f)) < 1e-4f);
+  assert(chunks.IsSilent(0, 1024));
+  assert(chunks.IsSilent(1536, 512));
+  assert(!chunks.IsSilent(1000, 100));
+  assert(!chunks.IsSilent(1500, 100));
+  
+  // The chunk being written and those never written have no summary.
+  assert(!chunks.valid(8) && !chunks.valid(20));
+  assert(!chunks.IsSilent(2100, 100));
+  
+  // Neither has a chunk in which recording resumed halfway.
+  buffer.Resync(128);
+  fill(&block[0], &block[kBlockSize], 0.0f);
+  for (int32_t i = 0; i < 16; ++i) {
+    buffer.Write(block, kBlockSize, 1);
+  }
+  assert(!chunks.valid(0));
+  assert(chunks.valid(1));
+
+  // Single samples are indexed like blocks.
+  vector<int16_t> sample_memory(kBufferSize + kInterpolationTail);
+  AudioBuffer<RESOLUTION_16_BIT> sample_buffer;
+  sample_buffer.Init(&sample_memory[0], sample_memory.size(), &tail[0]);
+  for (int32_t i = 0; i < 2048; ++i) {
+    sample_buffer.Write(i >= 1024 && i < 1536 ? (i & 1 ? 0.5f : -0.25f) : 0.0f);
+  }
+  assert(sample_buffer.chunks().IsSilent(0, 1024));
+  assert(fabs(sample_buffer.chunks().peak(4) - 0.5f) < 1e-4f);
+  assert(fabs(sample_buffer.chunks().rms(5) - sqrtf(0.15625f)) < 1e-4f);
+
+  // When recording resumes, the summaries describe the samples faded from
+  // those recorded while frozen, not the incoming silence.
+  vector<int16_t> fade_memory(kBufferSize + kInterpolationTail);
+  AudioBuffer<RESOLUTION_16_BIT> fade_buffer;
+  fade_buffer.Init(&fade_memory[0], fade_memory.size(), &tail[0]);
+  for (size_t j = 0; j < kBlockSize; ++j) {
+    block[j] = j & 1 ? 0.5f : -0.5f;
+  }
+  for (int32_t i = 0; i < kCrossFadeSize; i += kBlockSize) {
+    fade_buffer.WriteFade(block, kBlockSize, 1, false);
+  }
+  fill(&block[0], &block[kBlockSize], 0.0f);
+  for (int32_t i = 0; i < 512; i += kBlockSize) {
+    fade_buffer.WriteFade(block, kBlockSize, 1, true);
+  }
+  float peak = 0.0f;
+  for (int32_t i = 0; i < 256; ++i) {
+    peak = max(peak, fabsf(fade_buffer.ReadZOH(i, 0)));
+  }
+  assert(peak > 0.0f);
+  assert(!fade_buffer.chunks().IsSilent(0, 256));
+  assert(fabs(fade_buffer.chunks().peak(0) - peak) < 1e-3f);
+}
+
+template<Resolution resolution, typename T>
+void CheckSegmentedBuffer(int32_t split) {
+  const int32_t kBufferSize = 3000;
+  vector<T> contiguous_memory(kBufferSize + kInterpolationTail);
+  vector<T> memory(split + kInterpolationTail);
+  vector<T> extension(kBufferSize - split + kInterpolationTail);
+  vector<int16_t> tail(kCrossFadeSize);
+  AudioBuffer<resolution> contiguous;
+  AudioBuffer<resolution> segmented;
+  contiguous.Init(
+      &contiguous_memory[0], contiguous_memory.size(), &tail[0]);
+  segmented.Init(
+      &memory[0], memory.size(),
+      &extension[0], extension.size(),
+      &tail[0]);
+  assert(segmented.size() == kBufferSize);
+
+  // Irregular block sizes, so that block writes straddle the segment boundary
+  // and the wrap-around point at every possible offset. They must match
+  // sample-by-sample writes to a contiguous buffer.
+  float block[67];
+  for (int32_t i = 0; i < 200; ++i) {
+    int32_t size = 1 + (i * 13) % 67;
+    for (int32_t j = 0; j < size; ++j) {
+      block[j] = Random::GetFloat() - 0.5f;
+    }
+    for (int32_t j = 0; j < size; ++j) {
+      contiguous.Write(block[j]);
+    }
+    segmented.Write(block, size, 1);
+    assert(segmented.head() == contiguous.head());
+  }
+  for (int32_t i = 0; i < kBufferSize; ++i) {
+    assert(segmented.ReadZOH(i, 0) == contiguous.ReadZOH(i, 0));
+    assert(segmented.ReadLinear(i, 12345) == contiguous.ReadLinear(i, 12345));
+    assert(segmented.ReadHermite(i, 4567) == contiguous.ReadHermite(i, 4567));
+  }
+
+  // Block reads wrap around the buffer like single reads.
+  int32_t position[64];
+  float samples[64];
+  for (int32_t i = 0; i < 64; ++i) {
+    position[i] = ((2 * kBufferSize - 32 + i) << 12) + 1234;
+  }
+  segmented.ReadHermite(position, samples, 64, 0);
+  for (int32_t i = 0; i < 64; ++i) {
+    assert(samples[i] == contiguous.ReadHermite(
+        position[i] >> 12, position[i] << 4));
+  }
+}
+
+void TestSegmentedBuffer() {
+  CheckSegmentedBuffer<RESOLUTION_16_BIT, int16_t>(1024);
+  CheckSegmentedBuffer<RESOLUTION_16_BIT, int16_t>(2995);
+  CheckSegmentedBuffer<RESOLUTION_8_BIT_MU_LAW, int8_t>(1024);
+  CheckSegmentedBuffer<RESOLUTION_8_BIT_MU_LAW, int8_t>(2995);
+  CheckSegmentedBuffer<RESOLUTION_8_BIT_DITHERED, int8_t>(1024);
+  CheckSegmentedBuffer<RESOLUTION_8_BIT, int8_t>(2995);
+  CheckSegmentedBuffer<RESOLUTION_32_BIT_FLOAT, float>(1024);
+
+  // Float buffers store samples as they are, including overs.
+  vector<float> memory(64 + kInterpolationTail);
+  vector<int16_t> tail(kCrossFadeSize);
+  AudioBuffer<RESOLUTION_32_BIT_FLOAT> buffer;
+  buffer.Init(&memory[0], memory.size(), &tail[0]);
+  float block[4] = { 0.1f, -1.5f, 2.0f, 1.0f / 3.0f };
+  buffer.Write(block, 4, 1);
+  for (int32_t i = 0; i < 4; ++i) {
+    assert(buffer.ReadZOH(i, 0) == block[i]);
+  }
+  assert(buffer.ReadLinear(1, 32768) == 0.25f);
+}
+
+void WriteTone(
+    AudioBuffer<RESOLUTION_16_BIT>* buffer,
+    float frequency,
+    int32_t size) {
+  float block[kBlockSize];
+  float phase = 0.0f;
+  for (int32_t i = 0; i < size; i += kBlockSize) {
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      block[j] = 0.5f * sinf(phase * 2.0f * M_PI);
+      phase += frequency;
+      phase -= floorf(phase);
+    }
+    buffer->Write(block, kBlockSize, 1);
+  }
+}
+
+void TestPyramid() {
+  const int32_t kBufferSize = 4096;
+  vector<int16_t> memory(kBufferSize + kInterpolationTail);
+  vector<int16_t> pyramid(kBufferSize);
+  vector<int16_t> tail(kCrossFadeSize);
+  AudioBuffer<RESOLUTION_16_BIT> buffer;
+  buffer.Init(&memory[0], memory.size(), &tail[0]);
+  buffer.InitPyramid(&pyramid[0], pyramid.size() * sizeof(int16_t));
+  assert(buffer.num_pyramid_levels() == 2);
+  assert(buffer.pyramid_level(65536) == 0);
+  assert(buffer.pyramid_level(-3 * 65536) == 1);
+  assert(buffer.pyramid_level(5 * 65536) == 2);
+
+  // A low frequency tone reads the same from every level. The decimated
+  // copies lag behind the last few samples written.
+  WriteTone(&buffer, 0.01f, kBufferSize * 2);
+  assert(buffer.head() == 0);
+  for (int32_t i = 32; i < kBufferSize - 32; i += 7) {
+    float full = buffer.ReadHermite(i, 12345);
+    assert(fabs(buffer.ReadHermite(i, 12345, 1) - full) < 0.01f);
+    assert(fabs(buffer.ReadHermite(i, 12345, 2) - full) < 0.01f);
+    // Low and medium quality grains read them with their own interpolation.
+    float linear = buffer.ReadLinear(i, 12345);
+    assert(fabs(buffer.ReadPyramid<INTERPOLATION_LINEAR>(i, 12345, 2) -
+        linear) < 0.01f);
+    float zoh = buffer.ReadZOH(i & ~1, 0);
+    assert(fabs(buffer.ReadPyramid<INTERPOLATION_ZOH>(i, 0, 1) - zoh) < 0.01f);
+  }
+
+  // The decimated copies can be recomputed from the recording.
+  vector<int16_t> rebuilt(kBufferSize);
+  AudioBuffer<RESOLUTION_16_BIT> copy;
+  copy.Init(&memory[0], memory.size(), &tail[0]);
+  WriteTone(&copy, 0.01f, kBufferSize * 2);
+  copy.InitPyramid(&rebuilt[0], rebuilt.size() * sizeof(int16_t));
+  copy.RebuildPyramid();
+  for (int32_t i = 32; i < kBufferSize - 32; i += 7) {
+    assert(fabs(copy.ReadHermite(i, 0, 2) - buffer.ReadHermite(i, 0, 2)) <
+        0.001f);
+  }
+
+  // Content above the Nyquist frequency of a level is filtered out.
+  WriteTone(&buffer, 0.4f, kBufferSize * 2);
+  float energy[2] = { 0.0f, 0.0f };
+  for (int32_t i = 0; i < kBufferSize; ++i) {
+    float full = buffer.ReadHermite(i, 0);
+    float decimated = buffer.ReadHermite(i, 0, 1);
+    energy[0] += full * full;
+    energy[1] += decimated * decimated;
+  }
+  assert(energy[1] < energy[0] * 0.01f);
+}
+
+// Packs the signs of size samples, starting at start, as the WSOLA player
+// does.
+void PackSignBits(
+    const vector<float>& signal,
+    size_t start,
+    size_t size,
+    uint32_t* bits) {
+  for (size_t i = 0; i < size; ++i) {
+    uint32_t mask = 0x80000000 >> (i & 0x1f);
+    if (signal[start + i] > 0.0f) {
+      bits[i >> 5] |= mask;
+    } else {
+      bits[i >> 5] &= ~mask;
+    }
+  }
+}
+
+int32_t Search(Correlator* correlator, bool search_periods, int32_t size) {
+  correlator->set_search_periods(search_periods);
+  correlator->StartSearch(size, 0, 65536);
+  int32_t num_candidates = 0;
+  while (!correlator->done()) {
+    correlator->EvaluateNextCandidate();
+    ++num_candidates;
+  }
+  return num_candidates;
+}
+
+void TestCorrelator() {
+  const int32_t kSize = 2048;
+  const size_t kNumWords = kSize / 32 + 2;
+  vector<uint32_t> data(kNumWords * 3, 0);
+  Correlator correlator;
+  correlator.Init(&data[0], &data[kNumWords]);
+
+  // A tone with a period of 73.3 samples, with the window to match 1000
+  // samples into the destination.
+  vector<float> signal(kSize * 3);
+  for (size_t i = 0; i < signal.size(); ++i) {
+    float phase = i / 73.3f * 2.0f * M_PI;
+    signal[i] = sinf(phase) + 0.3f * sinf(2.0f * phase) + 0.02f *
+        (Random::GetFloat() - 0.5f);
+  }
+  PackSignBits(signal, 1000, kSize, correlator.source());
+  PackSignBits(signal, 0, kSize * 2, correlator.destination());
+
+  Search(&correlator, false, kSize);
+  int32_t full_match = correlator.best_match();
+  int32_t num_candidates = Search(&correlator, true, kSize);
+  assert(abs(correlator.period() - 73) <= 1);
+  assert(correlator.best_match() == full_match);
+  assert(abs(full_match - 1000) <= 1);
+  assert(num_candidates < kSize / 4);
+
+  // Noise gets the full search.
+  for (size_t i = 0; i < signal.size(); ++i) {
+    signal[i] = Random::GetFloat() - 0.5f;
+  }
+  PackSignBits(signal, 1000, kSize, correlator.source());
+  PackSignBits(signal, 0, kSize * 2, correlator.destination());
+  num_candidates = Search(&correlator, true, kSize);
+  assert(correlator.period() == 0);
+  assert(num_candidates == kSize + 1);
+  assert(correlator.best_match() == 1000);
+}
+
+void TestStftBacklog() {
+  const size_t kFftSize = 256;
+  const size_t kHopSize = kFftSize / 4;
+  FFT fft;
+  vector<float> fft_buffer(kFftSize);
+  vector<float> ifft_buffer(kFftSize);
+  vector<short> ana_syn_buffer((kFftSize + kHopSize) * 2);
+  STFT stft;
+  stft.Init(
+      &fft, kFftSize, kHopSize,
+      &fft_buffer[0], &ifft_buffer[0],
+      lut_sine_window_4096,
+      &ana_syn_buffer[0],
+      NULL);
+
+  Parameters parameters;
+  memset(&parameters, 0, sizeof(parameters));
+  vector<float> input(kHopSize, 0.1f);
+  vector<float> output(kHopSize);
+
+  // Keeping up.
+  for (size_t i = 0; i < 8; ++i) {
+    stft.Process(parameters, &input[0], &output[0], kHopSize, 1);
+    stft.Buffer();
+  }
+  assert(stft.num_processed_frames() == 8);
+  assert(stft.num_dropped_frames() == 0);
+  assert(stft.max_backlog() == 1);
+
+  // One hop late: the late frame is still processed.
+  stft.Process(parameters, &input[0], &output[0], kHopSize, 1);
+  stft.Process(parameters, &input[0], &output[0], kHopSize, 1);
+  stft.Buffer();
+  stft.Buffer();
+  assert(stft.num_processed_frames() == 10);
+  assert(stft.num_dropped_frames() == 0);
+
+  // Main loop stalled for 5 hops: all but the latest frame are dropped.
+  for (size_t i = 0; i < 5; ++i) {
+    stft.Process(parameters, &input[0], &output[0], kHopSize, 1);
+  }
+  assert(stft.backlog() == 5);
+  stft.Buffer();
+  assert(stft.backlog() == 0);
+  assert(stft.num_processed_frames() == 11);
+  assert(stft.num_dropped_frames() == 4);
+  assert(stft.max_backlog() == 5);
+}
+
+void RenderStrided(
+    GranularProcessor* processor,
+    size_t stride,
+    size_t num_blocks,
+    vector<short>* rendered) {
+  // Same input and seed for each rendering.
+  Random::Seed(0x21);
+  processor->set_num_channels(2);
+  processor->set_low_fidelity(false);
+  processor->set_playback_mode(PLAYBACK_MODE_GRANULAR);
+  processor->Prepare();
+
+  Parameters* p = processor->mutable_parameters();
+  p->position = 0.3f;
+  p->size = 0.6f;
+  p->pitch = 7.0f;
+  p->density = 0.8f;
+  p->texture = 0.5f;
+  p->dry_wet = 0.7f;
+  p->stereo_spread = 0.5f;
+  p->feedback = 0.2f;
+  p->reverb = 0.3f;
+
+  vector<short> input(kBlockSize * 2 * stride, 0x55);
+  vector<short> output(kBlockSize * 2 * stride, 0x55);
+  float phase = 0.0f;
+  for (size_t block = 0; block < num_blocks; ++block) {
+    for (size_t i = 0; i < kBlockSize; ++i) {
+      phase += 220.0f / kSampleRate;
+      if (phase >= 1.0f) {
+        phase -= 1.0f;
+      }
+      input[2 * i * stride] = 16384.0f * sinf(phase * M_PI * 2);
+      input[(2 * i + 1) * stride] = 16384.0f * (phase - 0.5f);
+    }
+    processor->Process(&input[0], &output[0], kBlockSize, stride);
+    processor->Prepare();
+    for (size_t i = 0; i < kBlockSize * 2 * stride; ++i) {
+      if (i % stride) {
+        // Padding is left untouched.
+        assert(output[i] == 0x55);
+      } else {
+        rendered->push_back(output[i]);
+      }
+    }
+  }
+}
+
+void TestStridedProcess() {
+  uint8_t large_buffer[118784];
+  uint8_t small_buffer[65536 - 128];
+  // Zero-initialized, as on the module.
+  static GranularProcessor processor[2];
+
+  vector<short> contiguous;
+  processor[0].Init(
+      &large_buffer[0], sizeof(large_buffer),
+      &small_buffer[0], sizeof(small_buffer));
+  RenderStrided(&processor[0], 1, 200, &contiguous);
+
+  // As in the DMA buffers of the WM8731 at 32kHz.
+  vector<short> strided;
+  processor[1].Init(
+      &large_buffer[0], sizeof(large_buffer),
+      &small_buffer[0], sizeof(small_buffer));
+  RenderStrided(&processor[1], 3, 200, &strided);
+
+  assert(*max_element(contiguous.begin(), contiguous.end()) > 0);
+  assert(contiguous == strided);
+}
+
+void SetDefaultParameters(Parameters* p) {
+  memset(p, 0, sizeof(Parameters));
+  p->position = 0.3f;
+  p->size = 0.6f;
+  p->pitch = 7.0f;
+  p->density = 0.3f;
+  p->texture = 0.3f;
+  p->dry_wet = 0.7f;
+  p->stereo_spread = 0.5f;
+  p->feedback = 0.0f;
+  p->reverb = 0.3f;
+}
+
+// Serializes the blocks as Settings::SaveSampleMemory() does.
+void SavePersistentData(
+    const PersistentBlock* blocks,
+    size_t num_blocks,
+    vector<uint32_t>* data) {
+  for (size_t i = 0; i < num_blocks; ++i) {
+    data->push_back(blocks[i].tag);
+    data->push_back(blocks[i].size);
+    const uint32_t* words = static_cast<const uint32_t*>(blocks[i].data);
+    data->insert(data->end(), words, words + blocks[i].size / 4);
+  }
+}
+
+void TestPersistentData() {
+  static uint8_t large_buffer[2][118784];
+  static uint8_t small_buffer[2][65536 - 128];
+  static GranularProcessor processor[2];
+  PlaybackMode modes[2] = { PLAYBACK_MODE_GRANULAR, PLAYBACK_MODE_OLIVERB };
+  for (int32_t i = 0; i < 2; ++i) {
+    processor[i].Init(
+        &large_buffer[i][0], sizeof(large_buffer[i]),
+        &small_buffer[i][0], sizeof(small_buffer[i]));
+    processor[i].set_num_channels(1);
+    processor[i].set_low_fidelity(false);
+    processor[i].set_playback_mode(modes[i]);
+    processor[i].Prepare();
+  }
+
+  // Fill the whole mono recording, including its second segment.
+  SetDefaultParameters(processor[0].mutable_parameters());
+  vector<short> input(kBlockSize * 2);
+  vector<short> output(kBlockSize * 2);
+  for (size_t n = 0; n < 3 * kSampleRate; n += kBlockSize) {
+    for (size_t i = 0; i < kBlockSize; ++i) {
+      input[2 * i] = input[2 * i + 1] = (Random::GetWord() >> 20) - 2048;
+    }
+    processor[0].Process(&input[0], &output[0], kBlockSize, 1);
+    processor[0].Prepare();
+  }
+
+  PersistentBlock saved[4];
+  size_t num_saved;
+  processor[0].PreparePersistentData();
+  processor[0].GetPersistentData(saved, &num_saved);
+  assert(num_saved == 3);
+  vector<uint32_t> data;
+  SavePersistentData(saved, num_saved, &data);
+  assert(data.size() * 4 <= kSampleMemorySize);
+  const int16_t* extension = static_cast<const int16_t*>(saved[2].data);
+  assert(*max_element(extension, extension + saved[2].size / 2) > 0);
+
+  // The recording is the same length in all modes, and is restored in full.
+  assert(processor[1].LoadPersistentData(&data[0]));
+  PersistentBlock loaded[4];
+  size_t num_loaded;
+  processor[1].GetPersistentData(loaded, &num_loaded);
+  assert(num_loaded == num_saved);
+  for (size_t i = 1; i < num_saved; ++i) {
+    assert(loaded[i].size == saved[i].size);
+    assert(!memcmp(loaded[i].data, saved[i].data, saved[i].size));
+  }
+
+  // A save with a corrupted buffer is rejected, and leaves the current
+  // recording untouched.
+  vector<uint32_t> corrupted(data);
+  corrupted[2 + sizeof(PersistentState) / 4 + 1] ^= 4;
+  vector<uint8_t> recording(
+      static_cast<const uint8_t*>(loaded[1].data),
+      static_cast<const uint8_t*>(loaded[1].data) + loaded[1].size);
+  assert(!processor[1].LoadPersistentData(&corrupted[0]));
+  assert(!memcmp(loaded[1].data, &recording[0], loaded[1].size));
+
+  // Mono saves made before the second segment existed end after the first
+  // one, in an erased flash sector. They are loaded with a silent second
+  // segment, and the write head in sync.
+  vector<uint32_t> baseline(
+      data.begin(),
+      data.begin() + 4 + (saved[0].size + saved[1].size) / 4);
+  baseline.resize(kSampleMemorySize / 4, 0xffffffff);
+  const PersistentState* saved_state = static_cast<const PersistentState*>(
+      saved[0].data);
+  assert(saved_state->write_head[0] != 0);
+  processor[1].set_num_channels(2);
+  processor[1].Prepare();
+  assert(processor[1].LoadPersistentData(&baseline[0]));
+  processor[1].GetPersistentData(loaded, &num_loaded);
+  assert(num_loaded == num_saved);
+  assert(!memcmp(loaded[1].data, saved[1].data, saved[1].size));
+  extension = static_cast<const int16_t*>(loaded[2].data);
+  assert(*max_element(extension, extension + loaded[2].size / 2) == 0);
+  assert(*min_element(extension, extension + loaded[2].size / 2) == 0);
+  processor[1].PreparePersistentData();
+  const PersistentState* loaded_state = static_cast<const PersistentState*>(
+      loaded[0].data);
+  assert(loaded_state->write_head[0] == saved_state->write_head[0]);
+}
+
+void RenderBlocks(
+    GranularProcessor* processor,
+    PlaybackMode playback_mode,
+    const Parameters& parameters,
+    size_t block_size,
+    size_t num_samples,
+    vector<short>* rendered,
+    size_t num_prepare_calls = 1) {
+  processor->set_num_channels(2);
+  processor->set_low_fidelity(false);
+  processor->set_playback_mode(playback_mode);
+  processor->Prepare();
+  *processor->mutable_parameters() = parameters;
+
+  vector<short> input(block_size * 2);
+  vector<short> output(block_size * 2);
+  float phase = 0.0f;
+  for (size_t n = 0; n < num_samples; n += block_size) {
+    for (size_t i = 0; i < block_size; ++i) {
+      phase += 220.0f / kSampleRate;
+      if (phase >= 1.0f) {
+        phase -= 1.0f;
+      }
+      input[2 * i] = 16384.0f * sinf(phase * M_PI * 2);
+      input[2 * i + 1] = 16384.0f * (phase - 0.5f);
+    }
+    processor->Process(&input[0], &output[0], block_size, 1);
+    // Prepare() runs once every kControlBlockSize samples, whatever the block
+    // size, so that the work it does in the background lands at the same
+    // sample.
+    if ((n + block_size) % kControlBlockSize == 0) {
+      for (size_t i = 0; i < num_prepare_calls; ++i) {
+        processor->Prepare();
+      }
+    }
+    rendered->insert(rendered->end(), output.begin(), output.end());
+  }
+}
+
+// Simulates the circular DMA transfers of the codec, and returns the delay
+// between an impulse at the input and its first appearance at the output.
+// At each half-transfer interrupt, the half of the RX buffer that has just
+// been received is processed into the same half of the TX buffer, which is
+// sent once the other half has been played.
+size_t MeasureRoundTripLatency(GranularProcessor* processor, size_t block_size) {
+  processor->set_num_channels(2);
+  processor->set_low_fidelity(false);
+  processor->set_playback_mode(PLAYBACK_MODE_LOOPING_DELAY);
+  processor->Prepare();
+
+  Parameters* p = processor->mutable_parameters();
+  memset(p, 0, sizeof(Parameters));
+  p->size = 0.5f;
+  p->texture = 0.5f;
+
+  vector<short> rx(block_size * 2 * 2, 0);
+  vector<short> tx(block_size * 2 * 2, 0);
+  const size_t impulse_time = 1000;
+  for (size_t t = 0; t < 8 * kSampleRate; ++t) {
+    size_t half = (t / block_size) % 2;
+    size_t offset = (half * block_size + t % block_size) * 2;
+    if (t > impulse_time && tx[offset] > 1024) {
+      return t - impulse_time;
+    }
+    rx[offset] = rx[offset + 1] = t == impulse_time ? 16384 : 0;
+    if ((t + 1) % block_size == 0) {
+      processor->Process(
+          &rx[half * block_size * 2],
+          &tx[half * block_size * 2],
+          block_size,
+          1);
+      processor->Prepare();
+    }
+  }
+  return 0;
+}
+
+void TestBlockSizes() {
+  uint8_t large_buffer[118784];
+  uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor[3];
+
+  // Control-rate updates happen every kControlBlockSize samples: smaller
+  // codec blocks do not change the rendering. This holds in every mode but
+  // Kammerl, which cuts its slices on the triggers received with each block.
+  Parameters parameters;
+  SetDefaultParameters(&parameters);
+  for (int32_t mode = 0; mode < PLAYBACK_MODE_LAST; ++mode) {
+    if (mode == PLAYBACK_MODE_KAMMERL) {
+      continue;
+    }
+    vector<short> reference;
+    for (size_t i = 0; i < 3; ++i) {
+      size_t block_size = kControlBlockSize >> (2 - i);
+      vector<short> rendered;
+      processor[i].Init(
+          &large_buffer[0], sizeof(large_buffer),
+          &small_buffer[0], sizeof(small_buffer));
+      // The resonestor only rings after the rising edge of the trigger.
+      parameters.trigger = mode == PLAYBACK_MODE_RESONESTOR;
+      Random::Seed(0x21);
+      RenderBlocks(
+          &processor[i],
+          static_cast<PlaybackMode>(mode),
+          parameters,
+          block_size,
+          32000,
+          &rendered);
+      if (i == 0) {
+        reference = rendered;
+        assert(*max_element(reference.begin(), reference.end()) > 0);
+      } else {
+        assert(rendered == reference);
+      }
+    }
+  }
+
+  for (size_t block_size = 8; block_size <= 32; block_size *= 2) {
+    processor[0].Init(
+        &large_buffer[0], sizeof(large_buffer),
+        &small_buffer[0], sizeof(small_buffer));
+    size_t latency = MeasureRoundTripLatency(&processor[0], block_size);
+    assert(latency == 2 * block_size);
+  }
+}
+
+// Energy of the first difference of one channel, emphasizing the highs.
+double HighFrequencyEnergy(const vector<short>& rendered, size_t channel) {
+  double energy = 0.0;
+  for (size_t i = channel + 2; i < rendered.size(); i += 2) {
+    double difference = rendered[i] - rendered[i - 2];
+    energy += difference * difference;
+  }
+  return energy;
+}
+
+void TestSpectralCrossover() {
+  uint8_t large_buffer[118784];
+  uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor[2];
+
+  // Processing the bins above 2kHz in bands keeps the level of the highs of
+  // the sine (left) and of the sawtooth (right).
+  Parameters parameters;
+  SetDefaultParameters(&parameters);
+  parameters.texture = 0.5f;
+  parameters.dry_wet = 1.0f;
+  vector<short> rendered[2];
+  for (size_t i = 0; i < 2; ++i) {
+    processor[i].Init(
+        &large_buffer[0], sizeof(large_buffer),
+        &small_buffer[0], sizeof(small_buffer));
+    processor[i].set_spectral_crossover(i ? 256 : 0);
+    RenderBlocks(
+        &processor[i],
+        PLAYBACK_MODE_SPECTRAL,
+        parameters,
+        32,
+        64000,
+        &rendered[i]);
+  }
+  for (size_t channel = 0; channel < 2; ++channel) {
+    double reference = HighFrequencyEnergy(rendered[0], channel);
+    double banded = HighFrequencyEnergy(rendered[1], channel);
+    assert(reference > 0.0);
+    assert(fabs(10.0 * log10(banded / reference)) < 1.5);
+  }
+}
+
+// Records a tone, then freezes the recording and returns the energy of the
+// wet output, transposed by the given number of semitones.
+double RenderTransposedTone(
+    GranularProcessor* processor,
+    PlaybackMode playback_mode,
+    float frequency,
+    float pitch) {
+  processor->set_num_channels(2);
+  processor->set_low_fidelity(false);
+  processor->set_playback_mode(playback_mode);
+  processor->Prepare();
+  Parameters* p = processor->mutable_parameters();
+  SetDefaultParameters(p);
+  p->pitch = pitch;
+  p->density = 0.8f;
+  // Leaves the filters of the looping delay open.
+  p->texture = 0.5f;
+  p->dry_wet = 1.0f;
+  p->reverb = 0.0f;
+
+  vector<short> input(kBlockSize * 2);
+  vector<short> output(kBlockSize * 2);
+  float phase = 0.0f;
+  double energy = 0.0;
+  Random::Seed(0x21);
+  for (size_t n = 0; n < 2 * kSampleRate; n += kBlockSize) {
+    p->freeze = n >= kSampleRate;
+    for (size_t i = 0; i < kBlockSize; ++i) {
+      phase += frequency / kSampleRate;
+      if (phase >= 1.0f) {
+        phase -= 1.0f;
+      }
+      input[2 * i] = input[2 * i + 1] = 16384.0f * sinf(phase * M_PI * 2);
+    }
+    processor->Process(&input[0], &output[0], kBlockSize, 1);
+    processor->Prepare();
+    if (p->freeze) {
+      for (size_t i = 0; i < kBlockSize * 2; ++i) {
+        energy += static_cast<double>(output[i]) * output[i];
+      }
+    }
+  }
+  return energy;
+}
+
+void TestProcessorPyramid() {
+  uint8_t large_buffer[118784];
+  uint8_t small_buffer[65536 - 128];
+  static uint8_t pyramid_buffer[131072];
+  static GranularProcessor processor;
+
+  // Grains and the frozen loop transposed up by two and three octaves read
+  // from the decimated copies of the recording: a low tone plays as without
+  // them, while a tone which would fold back above the Nyquist frequency is
+  // filtered out.
+  PlaybackMode modes[2] = {
+    PLAYBACK_MODE_GRANULAR,
+    PLAYBACK_MODE_LOOPING_DELAY
+  };
+  float pitches[2] = { 24.0f, 36.0f };
+  for (int32_t i = 0; i < 2; ++i) {
+    for (int32_t j = 0; j < 2; ++j) {
+      double energy[2][2];
+      for (int32_t pyramid = 0; pyramid < 2; ++pyramid) {
+        processor.Init(
+            &large_buffer[0], sizeof(large_buffer),
+            &small_buffer[0], sizeof(small_buffer));
+        if (pyramid) {
+          processor.set_pyramid_buffer(
+              &pyramid_buffer[0],
+              sizeof(pyramid_buffer));
+        }
+        energy[pyramid][0] = RenderTransposedTone(
+            &processor, modes[i], 100.0f, pitches[j]);
+        energy[pyramid][1] = RenderTransposedTone(
+            &processor, modes[i], 5000.0f, pitches[j]);
+      }
+      assert(energy[0][0] > 0.0);
+      assert(fabs(energy[1][0] / energy[0][0] - 1.0) < 0.05);
+      assert(energy[1][1] < energy[0][1] * 0.1);
+    }
+  }
+}
+
+// Gain in dB of a sine going through the decimator, and optionally back
+// through the interpolator.
+template<typename Down, typename Up>
+double ResamplerGain(float frequency, bool round_trip) {
+  const size_t kSize = 8192;
+  const size_t kSettle = 1024;
+  static FloatFrame input[kSize];
+  static FloatFrame downsampled[kSize / 2];
+  static FloatFrame output[kSize];
+  Down down;
+  Up up;
+  down.Init();
+  up.Init();
+  for (size_t i = 0; i < kSize; ++i) {
+    input[i].l = input[i].r = sinf(
+        2.0f * M_PI * frequency * i / kSampleRate);
+  }
+  for (size_t i = 0; i < kSize; i += kBlockSize) {
+    down.Process(&input[i], &downsampled[i / 2], kBlockSize);
+    up.Process(&downsampled[i / 2], &output[i], kBlockSize / 2);
+  }
+  const FloatFrame* measured = round_trip ? output : downsampled;
+  size_t size = round_trip ? kSize : kSize / 2;
+  size_t settle = round_trip ? kSettle : kSettle / 2;
+  double energy = 0.0;
+  double reference = 0.0;
+  for (size_t i = settle; i < size; ++i) {
+    energy += measured[i].l * measured[i].l;
+    reference += 0.5;
+  }
+  return 10.0 * log10(energy / reference);
+}
+
+void TestResamplers() {
+  typedef SampleRateConverter<-2, 45, src_filter_1x_2_45> FirDown;
+  typedef SampleRateConverter<+2, 45, src_filter_1x_2_45> FirUp;
+  typedef IirSampleRateConverter<-2, 4, src_filter_iir_2_4> IirDown;
+  typedef IirSampleRateConverter<+2, 4, src_filter_iir_2_4> IirUp;
+
+  // The IIR filters are at least as flat as the FIR ones in the passband,
+  // and reject at least as much above 9.6kHz.
+  const float passband[] = { 100.0f, 1000.0f, 3000.0f, 5000.0f, 6400.0f };
+  const float stopband[] = { 9600.0f, 11000.0f, 13000.0f, 15000.0f };
+  for (size_t i = 0; i < sizeof(passband) / sizeof(float); ++i) {
+    double fir = ResamplerGain<FirDown, FirUp>(passband[i], true);
+    double iir = ResamplerGain<IirDown, IirUp>(passband[i], true);
+    assert(fabs(iir) < 0.05);
+    assert(fabs(iir) <= fabs(fir) + 0.01);
+  }
+  for (size_t i = 0; i < sizeof(stopband) / sizeof(float); ++i) {
+    double fir = ResamplerGain<FirDown, FirUp>(stopband[i], false);
+    double iir = ResamplerGain<IirDown, IirUp>(stopband[i], false);
+    assert(iir < -50.0);
+    assert(iir <= fir);
+  }
+}
+
+void TestSweepRenderer() {
+  uint8_t large_buffer[118784];
+  uint8_t small_buffer[65536 - 128];
+  const size_t kNumVariants = 4;
+  static GranularProcessor processor[2][kNumVariants];
+  const size_t kNumSamples = 32000;
+  const PlaybackMode modes[] = {
+    PLAYBACK_MODE_LOOPING_DELAY,
+    PLAYBACK_MODE_STRETCH
+  };
+
+  // Variant 2 has feedback and records its own input, the others play from
+  // the recording of variant 0. All render as if they were on their own.
+  Parameters parameters[kNumVariants];
+  for (size_t i = 0; i < kNumVariants; ++i) {
+    SetDefaultParameters(&parameters[i]);
+    parameters[i].pitch = -5.0f + 4.0f * i;
+    parameters[i].size = 0.2f * (i + 1);
+  }
+  parameters[2].feedback = 0.4f;
+
+  for (size_t m = 0; m < sizeof(modes) / sizeof(PlaybackMode); ++m) {
+    SweepRenderer sweep;
+    sweep.Init(modes[m], 0, parameters, kNumVariants);
+    assert(sweep.num_shared() == kNumVariants - 2);
+
+    vector<ShortFrame> input(kBlockSize);
+    vector<ShortFrame> output(kBlockSize * kNumVariants);
+    ShortFrame* outputs[kNumVariants];
+    vector<short> rendered[kNumVariants];
+    for (size_t i = 0; i < kNumVariants; ++i) {
+      outputs[i] = &output[i * kBlockSize];
+    }
+    float phase = 0.0f;
+    for (size_t n = 0; n < kNumSamples; n += kBlockSize) {
+      for (size_t i = 0; i < kBlockSize; ++i) {
+        phase += 220.0f / kSampleRate;
+        if (phase >= 1.0f) {
+          phase -= 1.0f;
+        }
+        input[i].l = 16384.0f * sinf(phase * M_PI * 2);
+        input[i].r = 16384.0f * (phase - 0.5f);
+      }
+      sweep.Process(&input[0], outputs, kBlockSize);
+      for (size_t i = 0; i < kNumVariants; ++i) {
+        const short* samples = &outputs[i][0].l;
+        rendered[i].insert(
+            rendered[i].end(), samples, samples + kBlockSize * 2);
+      }
+    }
+    sweep.Done();
+
+    for (size_t i = 0; i < kNumVariants; ++i) {
+      vector<short> reference;
+      processor[m][i].Init(
+          &large_buffer[0], sizeof(large_buffer),
+          &small_buffer[0], sizeof(small_buffer));
+      RenderBlocks(
+          &processor[m][i],
+          modes[m],
+          parameters[i],
+          kBlockSize,
+          kNumSamples,
+          &reference);
+      assert(reference == rendered[i]);
+    }
+  }
+}
+
+void TestPrepareSchedule() {
+  uint8_t large_buffer[118784];
+  uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor[2][5];
+  const size_t kNumSamples = 64000;
+  const PlaybackMode modes[] = {
+    PLAYBACK_MODE_STRETCH,
+    PLAYBACK_MODE_SPECTRAL
+  };
+  
+  // The offline schedules render the same whatever the number of calls to
+  // Prepare() between two blocks. A large enough budget does everything.
+  const PrepareSchedule schedule[] = {
+    PREPARE_SCHEDULE_COMPLETE,
+    PREPARE_SCHEDULE_COMPLETE,
+    PREPARE_SCHEDULE_BUDGET,
+    PREPARE_SCHEDULE_BUDGET,
+    PREPARE_SCHEDULE_BUDGET
+  };
+  const float budget[] = { 0.0f, 0.0f, 64.0f, 64.0f, 1.0f / 64.0f };
+  const size_t num_prepare_calls[] = { 1, 3, 1, 3, 3 };
+  
+  Parameters parameters;
+  SetDefaultParameters(&parameters);
+  parameters.pitch = 3.0f;
+  for (size_t m = 0; m < sizeof(modes) / sizeof(PlaybackMode); ++m) {
+    vector<short> rendered[5];
+    for (size_t i = 0; i < 5; ++i) {
+      processor[m][i].Init(
+          &large_buffer[0], sizeof(large_buffer),
+          &small_buffer[0], sizeof(small_buffer));
+      processor[m][i].set_prepare_schedule(schedule[i]);
+      processor[m][i].set_prepare_budget(budget[i]);
+      Random::Seed(0x21);
+      RenderBlocks(
+          &processor[m][i],
+          modes[m],
+          parameters,
+          kBlockSize,
+          kNumSamples,
+          &rendered[i],
+          num_prepare_calls[i]);
+    }
+    assert(rendered[0] == rendered[1]);
+    assert(rendered[0] == rendered[2]);
+    assert(rendered[0] == rendered[3]);
+    assert(rendered[0] != rendered[4]);
+  }
+  
+  // With one slice every 64 blocks, the STFT can't keep up with a frame every
+  // 32 blocks and drops some.
+  const STFT& complete = processor[1][0].phase_vocoder().stft(0);
+  const STFT& starved = processor[1][4].phase_vocoder().stft(0);
+  assert(complete.num_dropped_frames() == 0);
+  assert(starved.num_dropped_frames() > 0);
+}
+
+void TestReverbBank() {
+  const size_t kNumLanes = ReverbBank::kNumLanes;
+  const size_t kNumSamples = 32000;
+  static uint16_t bank_buffer[ReverbBank::kMemorySize * kNumLanes];
+  static uint16_t buffer[ReverbBank::kMemorySize];
+  static ReverbBank bank;
+  static Reverb reverb[kNumLanes];
+
+  // Each lane gets its own input and parameters, and must render exactly
+  // like a reverb on its own.
+  bank.Init(bank_buffer);
+  vector<FloatFrame> signal[kNumLanes];
+  for (size_t i = 0; i < kNumLanes; ++i) {
+    bank.set_amount(i, 0.1f * (i + 1));
+    bank.set_input_gain(i, 0.2f);
+    bank.set_time(i, 0.35f + 0.08f * i);
+    bank.set_diffusion(i, 0.625f - 0.02f * i);
+    bank.set_lp(i, 0.3f + 0.05f * i);
+    signal[i].resize(kNumSamples);
+    float phase = 0.0f;
+    for (size_t n = 0; n < kNumSamples; ++n) {
+      phase += 110.0f * (i + 1) / kSampleRate;
+      if (phase >= 1.0f) {
+        phase -= 1.0f;
+      }
+      signal[i][n].l = n < kNumSamples / 2 ? sinf(phase * M_PI * 2) : 0.0f;
+      signal[i][n].r = n < kNumSamples / 2 ? phase - 0.5f : 0.0f;
+    }
+  }
+  vector<FloatFrame> rendered[kNumLanes];
+  for (size_t i = 0; i < kNumLanes; ++i) {
+    rendered[i] = signal[i];
+  }
+  for (size_t n = 0; n < kNumSamples; n += kBlockSize) {
+    FloatFrame* in_out[kNumLanes];
+    for (size_t i = 0; i < kNumLanes; ++i) {
+      in_out[i] = &rendered[i][n];
+    }
+    bank.Process(in_out, kBlockSize);
+  }
+
+  for (size_t i = 0; i < kNumLanes; ++i) {
+    reverb[i].Init(buffer);
+    reverb[i].set_amount(0.1f * (i + 1));
+    reverb[i].set_input_gain(0.2f);
+    reverb[i].set_time(0.35f + 0.08f * i);
+    reverb[i].set_diffusion(0.625f - 0.02f * i);
+    reverb[i].set_lp(0.3f + 0.05f * i);
+    vector<FloatFrame> reference(signal[i]);
+    for (size_t n = 0; n < kNumSamples; n += kBlockSize) {
+      reverb[i].Process(&reference[n], kBlockSize);
+    }
+    bool identical = true;
+    for (size_t n = 0; n < kNumSamples; ++n) {
+      identical = identical &&
+          reference[n].l == rendered[i][n].l &&
+          reference[n].r == rendered[i][n].r;
+    }
+    assert(identical);
+  }
+}
+
+void TestPitchShifter() {
+  const size_t kNumSamples = 10000;
+  static uint16_t buffer[2][4096];
+  static PitchShifter pitch_shifter[2];
+  vector<FloatFrame> signal(kNumSamples);
+  for (size_t n = 0; n < kNumSamples; ++n) {
+    signal[n].l = Random::GetFloat() - 0.5f;
+    signal[n].r = sinf(n * 0.01f);
+  }
+
+  // The block version matches the per-sample one, for chunks shorter and
+  // longer than kMaxBlockSize, at several window sizes and transpositions.
+  const float sizes[] = { 0.0f, 0.4f, 1.0f };
+  const float ratios[] = { 0.5f, 0.9f, 1.0f, 1.5f, 2.0f };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(float); ++i) {
+    for (size_t j = 0; j < sizeof(ratios) / sizeof(float); ++j) {
+      for (size_t k = 0; k < 2; ++k) {
+        pitch_shifter[k].Init(buffer[k]);
+        pitch_shifter[k].set_ratio(ratios[j]);
+        pitch_shifter[k].set_dry_wet(0.8f);
+        for (size_t n = 0; n < 200; ++n) {
+          pitch_shifter[k].set_size(sizes[i]);
+        }
+      }
+      vector<FloatFrame> per_sample(signal);
+      vector<FloatFrame> block(signal);
+      for (size_t n = 0; n < kNumSamples; ++n) {
+        pitch_shifter[0].Process(&per_sample[n]);
+      }
+      for (size_t n = 0, chunk = 1; n < kNumSamples; chunk = chunk % 67 + 5) {
+        size_t size = min(chunk, kNumSamples - n);
+        pitch_shifter[1].Process(&block[n], size);
+        n += size;
+      }
+      for (size_t n = 0; n < kNumSamples; ++n) {
+        assert(block[n].l == per_sample[n].l);
+        assert(block[n].r == per_sample[n].r);
+      }
+    }
+  }
+}
+
+#ifdef GRAIN_THREADS
+void TestGrainThreads() {
+  uint8_t large_buffer[118784];
+  uint8_t small_buffer[65536 - 128];
+  static GranularProcessor processor[3];
+  WorkerPool pool;
+  pool.Init(4);
+
+  // The rendering only depends on the seed, not on the scheduling of the
+  // workers, and stays close to the single-threaded one (the grains are
+  // summed in a different order). The reverb is off: it stores 12-bit
+  // samples, which would magnify these rounding differences.
+  Parameters parameters;
+  SetDefaultParameters(&parameters);
+  parameters.density = 0.05f;
+  parameters.reverb = 0.0f;
+  vector<short> rendered[3];
+  for (size_t i = 0; i < 3; ++i) {
+    Random::Seed(0x21);
+    processor[i].Init(
+        &large_buffer[0], sizeof(large_buffer),
+        &small_buffer[0], sizeof(small_buffer));
+    processor[i].set_worker_pool(i ? &pool : NULL);
+    RenderBlocks(
+        &processor[i],
+        PLAYBACK_MODE_GRANULAR,
+        parameters,
+        32,
+        64000,
+        &rendered[i]);
+  }
+  pool.Done();
+
+  assert(*max_element(rendered[0].begin(), rendered[0].end()) > 0);
+  assert(rendered[1] == rendered[2]);
+  for (size_t i = 0; i < rendered[0].size(); ++i) {
+    assert(abs(rendered[1][i] - rendered[0][i]) <= 1);
+  }
+}
+#endif  // GRAIN_THREADS
+
+void TestFlashWriter() {
+  const uint32_t kStartAddress = 0x08008000;
+  const size_t kBlockSize = 16384;
+  const size_t kNumBlocks = 6;
+  
+  vector<uint8_t> firmware(kBlockSize * kNumBlocks);
+  for (size_t i = 0; i < firmware.size(); ++i) {
+    firmware[i] = Random::GetWord() >> 24;
+  }
+  
+  SimulatedFlash flash;
+  FlashWriter<SimulatedFlash> writer;
+  writer.Init(&flash, kStartAddress);
+  
+  // Packets are received into one buffer while the other one is programmed.
+  uint8_t rx_buffer[2][kBlockSize];
+  size_t num_resyncs = 0;
+  for (size_t block = 0; block < kNumBlocks; ++block) {
+    uint8_t* buffer = rx_buffer[block & 1];
+    for (size_t i = 0; i < kBlockSize; i += 256) {
+      memcpy(buffer + i, &firmware[block * kBlockSize + i], 256);
+      uint32_t address = writer.address();
+      writer.Step(kFlashWordsPerSlice);
+      assert(writer.address() - address <= kFlashWordsPerSlice * 4);
+    }
+    // The previous block has been written in the meantime.
+    assert(!writer.busy());
+    if (writer.Write(buffer, kBlockSize)) {
+      ++num_resyncs;
+    }
+  }
+  writer.Flush();
+  
+  assert(writer.address() == kStartAddress + kBlockSize * kNumBlocks);
+  assert(!memcmp(flash.data(kStartAddress), &firmware[0], firmware.size()));
+  
+  // Only the blocks starting a sector (0x08008000, 0x0800C000, 0x08010000)
+  // interrupt the reception.
+  assert(flash.num_erases() == 3);
+  assert(num_resyncs == 3);
+  
+  // Once the sectors have been erased up front, writing the blocks does not
+  // interrupt the reception.
+  SimulatedFlash erased_flash;
+  writer.Init(&erased_flash, kStartAddress);
+  writer.Erase(firmware.size());
+  assert(erased_flash.num_erases() == 3);
+  for (size_t block = 0; block < kNumBlocks; ++block) {
+    assert(!writer.Write(&firmware[block * kBlockSize], kBlockSize));
+  }
+  writer.Flush();
+  assert(erased_flash.num_erases() == 3);
+  assert(!memcmp(
+      erased_flash.data(kStartAddress), &firmware[0], firmware.size()));
+}
+
+uint32_t Crc32(const vector<uint8_t>& data) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < data.size(); ++i) {
+    crc ^= data[i];
+    for (size_t j = 0; j < 8; ++j) {
+      crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+void PushWord(uint32_t word, vector<uint8_t>* data) {
+  for (size_t i = 0; i < 4; ++i) {
+    data->push_back(word >> (i * 8));
+  }
+}
+
+const uint32_t kUpdateStartAddress = 0x08008000;
+const size_t kUpdateBlockSize = 16384;
+const size_t kUpdatePacketSize = 256;
+const float kUpdatePacketDuration = kUpdatePacketSize * 8 / 12000.0f;
+const float kUpdateBlankDuration = 0.06f;
+
+// Number of filler packets sent by lz_compress.py while the sectors of an
+// image of the given size are erased.
+size_t NumFillerPackets(size_t size) {
+  float duration = 0.0f;
+  for (int32_t i = 0; i < kNumFlashSectors; ++i) {
+    if (kFlashSectorBaseAddress[i] >= kUpdateStartAddress &&
+        kFlashSectorBaseAddress[i] - kUpdateStartAddress < size) {
+      duration += SimulatedFlash::erase_duration(i);
+    }
+  }
+  return static_cast<size_t>(ceilf(duration / kUpdatePacketDuration)) + 2;
+}
+
+// Greedy encoder for the format of lz_compress.py, with a single candidate
+// per position.
+void LzCompress(
+    const vector<uint8_t>& data,
+    size_t num_filler_packets,
+    vector<uint8_t>* compressed) {
+  vector<size_t> last(65536, 0);
+  PushWord(kLzMagic, compressed);
+  PushWord(data.size(), compressed);
+  PushWord(Crc32(data), compressed);
+  PushWord(num_filler_packets, compressed);
+  compressed->resize(
+      (1 + num_filler_packets) * kUpdatePacketSize,
+      0xff);
+  size_t position = 0;
+  while (position < data.size()) {
+    size_t flags = compressed->size();
+    compressed->push_back(0);
+    for (size_t i = 0; i < 8 && position < data.size(); ++i) {
+      size_t length = 0;
+      size_t distance = 0;
+      if (position + kLzMinMatchLength <= data.size()) {
+        uint16_t hash = data[position] ^ (data[position + 1] << 4) ^
+            (data[position + 2] << 8);
+        size_t candidate = last[hash];
+        last[hash] = position + 1;
+        if (candidate && position + 1 - candidate <= kLzWindowSize) {
+          --candidate;
+          while (length < 18 && position + length < data.size() &&
+                 data[candidate + length] == data[position + length]) {
+            ++length;
+          }
+          distance = position - candidate;
+        }
+      }
+      if (length >= kLzMinMatchLength) {
+        compressed->push_back((distance - 1) & 0xff);
+        compressed->push_back(((distance - 1) >> 8) |
+            ((length - kLzMinMatchLength) << 4));
+        position += length;
+      } else {
+        (*compressed)[flags] |= 1 << i;
+        compressed->push_back(data[position++]);
+      }
+    }
+  }
+}
+
+// Transmits the payload to a receiver, packet by packet. As done by the
+// encoder, a blank follows every block, long enough for the erase if the block
+// starts a sector. The packets sent while the CPU is stalled by an erase are
+// lost, and the one cut by the end of the stall is reported as an error. The
+// receiver must ask for the carrier to be acquired again after each blank,
+// and only when the reception is interrupted.
+bool ReceiveImage(
+    const vector<uint8_t>& payload,
+    SimulatedFlash* flash,
+    UpdateReceiver<SimulatedFlash>* receiver) {
+  static uint8_t rx_buffer[2][kUpdateBlockSize];
+  receiver->Init(
+      flash, kUpdateStartAddress, &rx_buffer[0][0], kUpdateBlockSize);
+
+  float time = 0.0f;
+  float stalled_until = 0.0f;
+  bool lost = false;
+  // Packets are padded, as done by the encoder.
+  vector<uint8_t> packet(kUpdatePacketSize);
+  for (size_t offset = 0; offset < payload.size();
+       offset += kUpdatePacketSize) {
+    float start = time;
+    time += kUpdatePacketDuration;
+    if (start < stalled_until) {
+      lost = true;
+    } else {
+      if (lost && !receiver->expects_errors()) {
+        return false;
+      }
+      lost = false;
+      fill(packet.begin(), packet.end(), 0xff);
+      copy(
+          payload.begin() + offset,
+          payload.begin() + min(offset + kUpdatePacketSize, payload.size()),
+          packet.begin());
+      bool resync = receiver->ProcessPacket(&packet[0], kUpdatePacketSize);
+      float stall = flash->TakeStallDuration();
+      bool blank = (offset + kUpdatePacketSize) % kUpdateBlockSize == 0;
+      if (resync != (blank || stall > 0.0f)) {
+        return false;
+      }
+      stalled_until = time + stall;
+      receiver->Step(kFlashWordsPerSlice);
+      if (receiver->error()) {
+        return false;
+      }
+    }
+    size_t end = offset + kUpdatePacketSize;
+    if (end % kUpdateBlockSize == 0) {
+      uint32_t address = kUpdateStartAddress + end - kUpdateBlockSize;
+      time += kUpdateBlankDuration;
+      for (int32_t i = 0; i < kNumFlashSectors; ++i) {
+        if (address == kFlashSectorBaseAddress[i]) {
+          time += SimulatedFlash::erase_duration(i);
+        }
+      }
+    }
+  }
+  receiver->Flush();
+  return !lost && receiver->complete();
+}
+
+void TestLzDecoder() {
+  const uint32_t kStartAddress = 0x08008000;
+
+  // Code-like data: repeated fragments with variations, and some noise.
+  vector<uint8_t> firmware;
+  while (firmware.size() < 70000) {
+    uint32_t r = Random::GetWord();
+    if (r & 1) {
+      firmware.push_back(r >> 24);
+    } else if (firmware.size() > 4096) {
+      size_t start = firmware.size() - 1 - ((r >> 8) & 4095);
+      size_t length = 3 + ((r >> 20) & 31);
+      for (size_t i = 0; i < length; ++i) {
+        firmware.push_back(firmware[start + i]);
+      }
+    } else {
+      firmware.push_back(0);
+    }
+  }
+
+  vector<uint8_t> compressed;
+  LzCompress(firmware, NumFillerPackets(firmware.size()), &compressed);
+  assert(compressed.size() < firmware.size() * 3 / 4);
+
+  // The sectors are erased after the header, while the filler packets are
+  // sent. The blocks are then written without interrupting the reception.
+  static SimulatedFlash flash;
+  static UpdateReceiver<SimulatedFlash> receiver;
+  const LzDecoder& lz_decoder = receiver.lz_decoder();
+  assert(ReceiveImage(compressed, &flash, &receiver));
+  assert(lz_decoder.compressed());
+  assert(lz_decoder.size() == firmware.size());
+  assert(flash.num_erases() == 3);
+  assert(!memcmp(flash.data(kStartAddress), &firmware[0], firmware.size()));
+  // The last block is padded with 0xff.
+  assert(flash.data(kStartAddress)[firmware.size()] == 0xff);
+
+  // Without the filler packets, the data sent during the erase is lost.
+  vector<uint8_t> unpadded;
+  LzCompress(firmware, 0, &unpadded);
+  static SimulatedFlash unpadded_flash;
+  assert(!ReceiveImage(unpadded, &unpadded_flash, &receiver));
+
+  // Corrupted data is caught by the CRC.
+  compressed[compressed.size() / 2] ^= 0x10;
+  static SimulatedFlash corrupted_flash;
+  assert(!ReceiveImage(compressed, &corrupted_flash, &receiver));
+
+  // Uncompressed images are passed through. Only full blocks are written,
+  // and their erases fall into the blanks left by the encoder.
+  static SimulatedFlash raw_flash;
+  firmware.resize(65536);
+  assert(ReceiveImage(firmware, &raw_flash, &receiver));
+  assert(!lz_decoder.compressed());
+  assert(raw_flash.num_erases() == 3);
+  assert(!memcmp(raw_flash.data(kStartAddress), &firmware[0], firmware.size()));
+}
+
+void TestCvMapper() {
+  CalibrationData calibration_data;
+  calibration_data.pitch_offset = 66.67f;
+  calibration_data.pitch_scale = -84.26f;
+  fill(&calibration_data.offset[0], &calibration_data.offset[ADC_CHANNEL_LAST],
+      0.5f);
+
+  CvMapper mapper;
+  mapper.Init(&calibration_data);
+
+  // CV inputs at rest, all pots at noon.
+  float values[ADC_CHANNELS_TOTAL];
+  fill(&values[0], &values[ADC_CHANNEL_LAST], 0.5f);
+  fill(&values[ADC_CHANNEL_LAST], &values[ADC_CHANNELS_TOTAL], 0.5f);
+  GateEvents gates;
+  memset(&gates, 0, sizeof(gates));
+
+  Parameters parameters;
+  memset(&parameters, 0, sizeof(parameters));
+  parameters.freeze = true;
+  for (size_t i = 0; i < 2000; ++i) {
+    mapper.Process(values, gates);
+  }
+  mapper.Read(&parameters);
+  assert(fabs(parameters.position - 0.5f) < 1e-3f);
+  assert(fabs(parameters.density - 0.5f) < 1e-3f);
+  assert(fabs(parameters.texture - 0.5f) < 1e-3f);
+  assert(!parameters.trigger);
+  // No freeze edge: the state set by the UI is left untouched.
+  assert(parameters.freeze);
+
+  // A trigger is seen exactly once, after the ADC latency, even when the
+  // audio code reads the parameters more or less often than they are
+  // updated.
+  for (size_t audio_per_control = 1; audio_per_control <= 4;
+       ++audio_per_control) {
+    size_t num_triggers = 0;
+    for (size_t i = 0; i < 20; ++i) {
+      gates.trigger_rising_edge = i == 3;
+      mapper.Process(values, gates);
+      for (size_t j = 0; j < audio_per_control; ++j) {
+        mapper.Read(&parameters);
+        num_triggers += parameters.trigger ? 1 : 0;
+      }
+    }
+    assert(num_triggers == 1);
+  }
+
+  size_t num_triggers = 0;
+  for (size_t i = 0; i < 40; ++i) {
+    gates.trigger_rising_edge = i == 3;
+    mapper.Process(values, gates);
+    if (i % 4 == 3) {
+      mapper.Read(&parameters);
+      num_triggers += parameters.trigger ? 1 : 0;
+    }
+  }
+  assert(num_triggers == 1);
+
+  gates.trigger_rising_edge = false;
+  gates.freeze_falling_edge = true;
+  mapper.Process(values, gates);
+  mapper.Read(&parameters);
+  assert(!parameters.freeze);
+}
+
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+  TestNonlinearities();
+  TestKernels();
+  TestOnsetIndex();
+  TestChunkIndex();
+  TestSegmentedBuffer();
+  TestPyramid();
+  TestCorrelator();
+  TestStftBacklog();
+  TestStridedProcess();
+  TestPersistentData();
+  TestBlockSizes();
+  TestSpectralCrossover();
+  TestProcessorPyramid();
+  TestResamplers();
+  TestSweepRenderer();
+  TestPrepareSchedule();
+  TestReverbBank();
+  TestPitchShifter();
+#ifdef GRAIN_THREADS
+  TestGrainThreads();
+#endif  // GRAIN_THREADS
+  TestFlashWriter();
+  TestLzDecoder();
+  TestCvMapper();
   TestDSP();
   // TestGrainSize();
 }